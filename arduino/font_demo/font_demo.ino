@@ -68,7 +68,8 @@ void setup()
 
     for (int i = 0; i < 10; i++) {
         char c = '0' + i;
-        uint16_t col = i * 32 + 16 - consolas_italic_36.width(c) / 2;
+        uint16_t col = text_align(i * 32, 32, consolas_italic_36.width(c),
+                                  Align::center);
         lcd.print(consolas_italic_36, row, col, Pixel::red, Pixel::white, c);
     }
     row += consolas_italic_36.height();
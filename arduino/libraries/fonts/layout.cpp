@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include "font.h"
+#include "layout.h"
+
+
+// width in pixels of (part of) a string
+int text_width(const Font& font, const char *str, int len)
+{
+    int width = 0;
+    while (len-- != 0 && *str != '\0')
+        width += font.width(*str++);
+    return width;
+}
+
+
+// find the first line of str that fits in width pixels
+const char *text_wrap(const Font& font, const char *str, int width,
+                      int *line_len, int *line_width)
+{
+    const char *p = str;
+    int x = 0;
+
+    // end of the last word that fit (where a soft break would go), and
+    // the line width up to there
+    const char *brk = nullptr;
+    int brk_x = 0;
+
+    while (*p != '\0' && *p != '\n') {
+        char c = *p;
+        if (c == ' ') {
+            if (p > str && p[-1] != ' ') {
+                brk = p;
+                brk_x = x;
+            }
+        } else if (x + font.width(c) > width && p > str) {
+            if (brk != nullptr) {
+                // break after the last word that fit
+                *line_len = brk - str;
+                *line_width = brk_x;
+                p = brk;
+                while (*p == ' ')
+                    p++;
+                return p;
+            }
+            // word does not fit by itself; break it here
+            break;
+        }
+        x += font.width(c);
+        p++;
+    }
+
+    // end of string, newline, or mid-word break at p; drop trailing spaces
+    const char *end = p;
+    while (end > str && end[-1] == ' ') {
+        end--;
+        x -= font.width(' ');
+    }
+    *line_len = end - str;
+    *line_width = x;
+
+    if (*p == '\n')
+        p++;
+    return p;
+}
+
+
+// number of lines str wraps to
+int text_lines(const Font& font, const char *str, int width)
+{
+    int lines = 0;
+    int len, w;
+    while (*str != '\0') {
+        str = text_wrap(font, str, width, &len, &w);
+        lines++;
+    }
+    return lines;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+struct Font;
+
+
+// Text measurement and layout, without rendering.
+//
+// Nothing here allocates memory or looks at glyph data, only the metrics
+// in struct Font, so it is cheap enough to lay out a screen of text every
+// time it is drawn.
+
+
+// Rectangle on screen, in pixels
+struct Rect {
+    int16_t row;
+    int16_t col;
+    int16_t height;
+    int16_t width;
+
+    bool contains(int r, int c, int h, int w) const
+    {
+        return r >= row && (r + h) <= (row + height) &&
+               c >= col && (c + w) <= (col + width);
+    }
+
+    bool intersects(int r, int c, int h, int w) const
+    {
+        return r < (row + height) && (r + h) > row &&
+               c < (col + width) && (c + w) > col;
+    }
+};
+
+
+enum class Align { left, center, right };
+
+
+// Width in pixels of the first len characters of str, or all of it if len
+// is negative. Characters not in the font are zero width.
+int text_width(const Font& font, const char *str, int len=-1);
+
+// Find the first line of str that fits in width pixels.
+//
+// Lines are broken at spaces if possible, and mid-word if a word by itself
+// does not fit. A '\n' always ends a line. At least one character is put
+// on each line so progress is always made.
+//
+// On return, *line_len is the number of characters in the line (trailing
+// spaces not included) and *line_width is its width in pixels. The return
+// value is where the next line starts, with spaces at a soft break skipped;
+// it points at the terminating '\0' when there are no more lines.
+const char *text_wrap(const Font& font, const char *str, int width,
+                      int *line_len, int *line_width);
+
+// Number of lines str wraps to in width pixels
+int text_lines(const Font& font, const char *str, int width);
+
+// Column at which to start a line line_width wide so it is aligned in the
+// span of width pixels starting at col. A line wider than the span is
+// aligned the same way, hanging out one or both ends. Centering is
+// col + width / 2 - line_width / 2, each half rounded toward zero.
+inline int text_align(int col, int width, int line_width, Align align)
+{
+    if (align == Align::center)
+        return col + width / 2 - line_width / 2;
+    else if (align == Align::right)
+        return col + width - line_width;
+    else
+        return col;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+// A pre-rendered rectangle of pixels, e.g. a label created by make_font -l.
+//
+// Pixels are uint16_t packed the same as Ws24's Pixel, so they can be sent
+// to the display as they are.
+//
+// If rle is false, data[] is height * width pixels, row by row.
+//
+// If rle is true, data[] is chunks, each starting with a count word:
+//   0x8000 | n:  next word is one pixel, repeated n times
+//   n:           next n words are pixels
+//
+// len is the number of uint16_t in data[] either way.
+
+struct Sprite {
+    int16_t height;
+    int16_t width;
+    bool rle;
+    int32_t len;
+    const uint16_t *data;
+};
@@ -0,0 +1,174 @@
+#include <Arduino.h>
+#include <cstdint>
+#include "font.h"
+#include "ws24.h"
+#include "console.h"
+
+
+Console::Console(Ws24& lcd, const Font& font, Pixel fg, Pixel bg) :
+    _lcd(lcd),
+    _font(font),
+    _fg(fg),
+    _bg(bg),
+    _cell_height(0),
+    _cell_width(0),
+    _rows(0),
+    _cols(0),
+    _row(0),
+    _col(0),
+    _top(0),
+    _scroll(false),
+    _scroll_top(0)
+{
+}
+
+
+Console::~Console()
+{
+}
+
+
+// clear screen and set up scrolling
+void Console::begin()
+{
+    _cell_height = _font.height();
+    _cell_width = _font.max_width();
+    _rows = _lcd.height() / _cell_height;
+    _cols = _lcd.width() / _cell_width;
+    _row = 0;
+    _col = 0;
+    _top = 0;
+
+    // physical height is height when not rotated sideways
+    int rotate = _lcd.rotation();
+    _scroll = (rotate == 0 || rotate == 180);
+    uint16_t phy_height = _scroll ? _lcd.height() : _lcd.width();
+
+    if (_scroll) {
+        // Leftover lines are a fixed area at the logical bottom. With
+        // rotation 180, the logical bottom is the physical top.
+        uint16_t scroll_height = _rows * _cell_height;
+        uint16_t fixed = phy_height - scroll_height;
+        if (rotate == 0) {
+            _scroll_top = 0;
+            _lcd.scroll_area(0, scroll_height, fixed);
+        } else {
+            _scroll_top = fixed;
+            _lcd.scroll_area(fixed, scroll_height, 0);
+        }
+        _lcd.scroll_start(_scroll_top);
+    } else {
+        // not scrolling; make sure the display is not left scrolled
+        _scroll_top = 0;
+        _lcd.scroll_area(0, phy_height, 0);
+        _lcd.scroll_start(0);
+    }
+
+    _lcd.write(0, 0, _lcd.height(), _lcd.width(), _bg);
+}
+
+
+// colors for subsequent characters
+void Console::color(Pixel fg, Pixel bg)
+{
+    _fg = fg;
+    _bg = bg;
+}
+
+
+// print a character at the cursor
+void Console::print(char c)
+{
+    if (_rows == 0 || _cols == 0)
+        return;
+
+    if (c == '\n') {
+        newline();
+        return;
+    }
+
+    if (c == '\r') {
+        _col = 0;
+        return;
+    }
+
+    if (c < 0 || c > 127 || _font.info[c].off < 0)
+        return;
+
+    if (_col >= _cols)
+        newline();
+
+    _lcd.print(_font, line_row(_row), _col * _cell_width, _fg, _bg, c);
+
+    // Font::width() might be less than the cell; pad to the cell so
+    // whatever was there before is overwritten
+    int pad = _cell_width - _font.width(c);
+    if (pad > 0)
+        _lcd.write(line_row(_row), _col * _cell_width + _font.width(c),
+                   _cell_height, pad, _bg);
+
+    _col++;
+}
+
+
+// print a string at the cursor
+void Console::print(const char *str)
+{
+    while (*str != '\0')
+        print(*str++);
+}
+
+
+// Row address (in logical coordinates) of a screen line.
+//
+// Rotation 0: the memory line shown at the top of the scrolling area is the
+// scroll start, so screen line n is memory line (n + _top) * _cell_height.
+//
+// Rotation 180: rows are mirrored when written, and the scroll start is
+// moved the other way (see newline()), which works out to the same row
+// address.
+uint16_t Console::line_row(int row) const
+{
+    return ((row + _top) % _rows) * _cell_height;
+}
+
+
+// fill screen line with background
+void Console::clear_line(int row)
+{
+    _lcd.write(line_row(row), 0, _cell_height, _lcd.width(), _bg);
+}
+
+
+// move cursor to the start of the next line, scrolling if needed
+void Console::newline()
+{
+    _col = 0;
+
+    if (_row < _rows - 1) {
+        _row++;
+        return;
+    }
+
+    if (!_scroll) {
+        // wrap to top line
+        _row = 0;
+        clear_line(_row);
+        return;
+    }
+
+    // Scroll up one text line; what was the top line becomes the bottom
+    // line. With rotation 0, the memory line at the top of the scrolling
+    // area moves down in memory. With rotation 180 the screen is upside
+    // down, and the memory line at the (physical) top moves up instead.
+    _top = (_top + 1) % _rows;
+
+    uint16_t start;
+    if (_lcd.rotation() == 0)
+        start = _scroll_top + _top * _cell_height;
+    else
+        start = _scroll_top + ((_rows - _top) % _rows) * _cell_height;
+    _lcd.scroll_start(start);
+
+    clear_line(_row);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include "ws24.h"
+
+
+struct Font;
+
+
+// Scrolling text console on a Ws24.
+//
+// The font is treated as monospace; every character cell is max_width()
+// wide and height() tall. Text wraps at the right edge of the screen.
+//
+// When the screen rotation is 0 or 180, scrolling is done with the
+// controller's vertical scrolling: the scroll start line is moved by one
+// text line, and only the newly exposed line is cleared. The rest of the
+// screen is not redrawn. The text lines are a ring in frame memory, and
+// each line's frame memory rows do not change once the console is started.
+//
+// Limitation: with rotation 90 or 270 the console does not scroll. The
+// hardware only scrolls along the physical (portrait) rows, which would
+// move the text sideways. Instead, a new line after the last one wraps
+// back to the top line and clears it, leaving the older lines below it,
+// so the screen no longer reads top to bottom in order. The cost per new
+// line is the same as scrolling.
+//
+// Lines left over at the bottom of the screen (height not a multiple of
+// the font height) are not used, and are outside the scrolling area.
+
+class Console {
+
+    public:
+
+        Console(Ws24& lcd, const Font& font,
+                Pixel fg=Pixel::black, Pixel bg=Pixel::white);
+
+        virtual ~Console();
+
+        // clear screen and set up scrolling; call after lcd.begin()
+        void begin();
+
+        // colors for subsequent characters (and cleared lines)
+        void color(Pixel fg, Pixel bg);
+
+        // print a character at the cursor
+        // '\n' moves to the start of the next line, '\r' to the start of
+        // the current line; other characters not in the font are skipped
+        void print(char c);
+
+        // print a string at the cursor
+        void print(const char *str);
+
+        // size of console in characters
+        int rows() const { return _rows; }
+        int cols() const { return _cols; }
+
+    private:
+
+        Ws24& _lcd;
+        const Font& _font;
+
+        Pixel _fg;
+        Pixel _bg;
+
+        // character cell size in pixels
+        int _cell_height;
+        int _cell_width;
+
+        // console size in characters
+        int _rows;
+        int _cols;
+
+        // cursor; _row is the screen line, 0 at top
+        int _row;
+        int _col;
+
+        // Text line slot shown at the top of the screen. Screen line n is
+        // at slot (n + _top) % _rows, which is at frame memory row address
+        // slot * _cell_height in the logical (rotated) coordinates.
+        int _top;
+
+        // true if hardware scrolling is used (rotation 0 or 180)
+        bool _scroll;
+
+        // physical height of the top fixed area
+        uint16_t _scroll_top;
+
+        uint16_t line_row(int row) const;
+        void clear_line(int row);
+        void newline();
+};
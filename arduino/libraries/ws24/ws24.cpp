@@ -2,7 +2,9 @@
 #include <cstdint>
 #include <SPI.h>
 #include "font.h"
+#include "sprite.h"
 #include "ws24.h"
+#include "ws24_bus.h"
 
 const Pixel Pixel::black(0, 0, 0);
 const Pixel Pixel::white(255, 255, 255);
@@ -22,9 +24,18 @@ Ws24::Ws24(SPIClass& spi,
     _gpio_bl(gpio_bl),
     _height(phy_height),
     _width(phy_width),
+    _rotate(0),
     _work(work),
-    _work_bytes(work_bytes)
+    _work_bytes(work_bytes),
+    _fill_count(0),
+    _fill_generation(0),
+    _bus(nullptr),
+    _stats_depth(0),
+    _trace_fn(nullptr),
+    _trace_arg(nullptr)
 {
+    memset(&_stats, 0, sizeof(_stats));
+
     digitalWrite(_gpio_spi_cs, 1);
     digitalWrite(_gpio_reset, 0);
     digitalWrite(_gpio_dc, 0);
@@ -38,9 +49,15 @@ Ws24::Ws24(SPIClass& spi,
 
 Ws24::~Ws24()
 {
+    // finish anything queued and make sure the bus forgets this display
+    if (_bus != nullptr)
+        _bus->remove(*this);
 }
 
 
+uint32_t Ws24::_work_generation = 0;
+
+
 // reset and initialize
 bool Ws24::begin(int rotate, int br)
 {
@@ -132,21 +149,21 @@ bool Ws24::begin(int rotate, int br)
 
     write(pixel_format_set, 0x55);
 
-    uint8_t madctl_param = 0x08;
     _height = phy_height;
     _width = phy_width;
+    _rotate = 0;
     if (rotate == 90) {
-        madctl_param |= 0x60;
         _height = phy_width;
         _width = phy_height;
+        _rotate = 90;
     } else if (rotate == 180) {
-        madctl_param |= 0xc0;
+        _rotate = 180;
     } else if (rotate == -90 || rotate == 270) {
-        madctl_param |= 0xa0;
         _height = phy_width;
         _width = phy_height;
+        _rotate = 270;
     }
-    write(memory_access_ctl, madctl_param);
+    write(memory_access_ctl, madctl(_rotate));
 
     // frame rate control
     // diva = 0b00              fosc
@@ -203,46 +220,221 @@ void Ws24::write(uint16_t row, uint16_t col,
                  uint16_t height, uint16_t width,
                  Pixel *data) // data[height * width], overwritten
 {
-    write(page_adrs_set, row, row + height - 1);
-    write(column_adrs_set, col, col + width - 1);
+    sync();
+
+    uint32_t start = call_begin();
+
+    window(row, col, height, width);
     write(memory_write, data, height * width * 2);
+
+    call_end(Ws24Call::pixels, start);
 }
 
 
 // Fill a rectangle with a solid color.
-// Use the work buffer, sending that much repeatedly until enough pixels have
-// been sent.
 void Ws24::write(uint16_t row, uint16_t col,
                  uint16_t height, uint16_t width, Pixel pixel)
 {
-    uint32_t cnt_pixels = (uint32_t)(height) * (uint32_t)(width);
-    uint8_t cmd_byte = memory_write;
+    sync();
 
-    // work buffer, used to hold Pixels (two bytes each)
-    const int work_pixels = _work_bytes / sizeof(Pixel);
-    Pixel *work_pix = (Pixel *)_work;
+    uint32_t start = call_begin();
 
-    write(page_adrs_set, row, row + height - 1);
-    write(column_adrs_set, col, col + width - 1);
+    window(row, col, height, width);
+    send_fill(memory_write, pixel, (uint32_t)(height) * (uint32_t)(width));
 
-    while (cnt_pixels > 0) {
+    call_end(Ws24Call::fill, start);
+}
 
-        // spi_pixels is minimum of pixels left and work size in pixels
-        uint32_t spi_pixels = cnt_pixels;
-        if (spi_pixels > work_pixels)
-            spi_pixels = work_pixels;
 
-        // fill work buf with pixel (it gets overwritten each time)
-        for (int i = 0; i < spi_pixels; i++)
-            work_pix[i] = pixel;
+// Fill a batch of rectangles.
+void Ws24::fill(Fill *fills, int count)
+{
+    sync();
+
+    uint32_t start = call_begin();
+
+    // Insertion sort by color, column, width, row; batches are the size of
+    // a screen layout, and often nearly sorted already. A fill stops moving
+    // ahead when it reaches one it overlaps in a different color, so what
+    // ends up on top is the same as in the caller's order.
+    for (int i = 1; i < count; i++) {
+        Fill f = fills[i];
+        int j = i;
+        while (j > 0 && fill_before(f, fills[j - 1]) &&
+               !fill_overlap(f, fills[j - 1])) {
+            fills[j] = fills[j - 1];
+            j--;
+        }
+        fills[j] = f;
+    }
+
+    // window last set here, to skip commands that would not change it
+    int win_row = -1, win_height = 0;
+    int win_col = -1, win_width = 0;
+
+    int i = 0;
+    while (i < count) {
+        Pixel pixel = fills[i].pixel;
+        int row = fills[i].rect.row;
+        int col = fills[i].rect.col;
+        int height = fills[i].rect.height;
+        int width = fills[i].rect.width;
+        i++;
+
+        // take in same-color rectangles directly below
+        while (i < count &&
+               fills[i].pixel.raw() == pixel.raw() &&
+               fills[i].rect.col == col && fills[i].rect.width == width &&
+               fills[i].rect.row == row + height) {
+            height += fills[i].rect.height;
+            i++;
+        }
+
+        // clip to screen
+        if (row < 0) {
+            height += row;
+            row = 0;
+        }
+        if (col < 0) {
+            width += col;
+            col = 0;
+        }
+        if (height > _height - row)
+            height = _height - row;
+        if (width > _width - col)
+            width = _width - col;
+        if (height <= 0 || width <= 0)
+            continue;
+
+        if (row != win_row || height != win_height) {
+            write(page_adrs_set, row, row + height - 1);
+            win_row = row;
+            win_height = height;
+        }
+        if (col != win_col || width != win_width) {
+            write(column_adrs_set, col, col + width - 1);
+            win_col = col;
+            win_width = width;
+        }
+
+        send_fill(memory_write, pixel, (uint32_t)height * (uint32_t)width);
+    }
+
+    call_end(Ws24Call::fill, start);
+}
+
+
+// order of fills in fill()
+bool Ws24::fill_before(const Fill& a, const Fill& b)
+{
+    if (a.pixel.raw() != b.pixel.raw())
+        return a.pixel.raw() < b.pixel.raw();
+    if (a.rect.col != b.rect.col)
+        return a.rect.col < b.rect.col;
+    if (a.rect.width != b.rect.width)
+        return a.rect.width < b.rect.width;
+    return a.rect.row < b.rect.row;
+}
+
+
+// true if the order of fills a and b matters: different colors, overlapping
+bool Ws24::fill_overlap(const Fill& a, const Fill& b)
+{
+    return a.pixel.raw() != b.pixel.raw() &&
+           a.rect.intersects(b.rect.row, b.rect.col,
+                             b.rect.height, b.rect.width);
+}
+
+
+// Draw a frame.
+void Ws24::frame(const Rect& box, int thickness, Pixel pixel)
+{
+    Fill fills[4];
+    fill(fills, frame_fills(fills, box, thickness, pixel));
+}
+
 
-        // Write data. First time is memory_write, after that
-        // memory_write_continue.
-        write(cmd_byte, _work, spi_pixels * 2);
+// Edges of a frame as fills.
+int frame_fills(Fill *fills, const Rect& box, int thickness, Pixel pixel)
+{
+    if (box.height <= 0 || box.width <= 0 || thickness < 1)
+        return 0;
 
-        cnt_pixels -= spi_pixels;
-        cmd_byte = memory_write_continue;
+    if (2 * thickness >= box.height || 2 * thickness >= box.width) {
+        fills[0] = { box, pixel };
+        return 1;
     }
+
+    const int16_t inner = box.height - 2 * thickness;
+
+    fills[0] = { { box.row, box.col, int16_t(thickness), box.width }, pixel };
+    fills[1] = { { int16_t(box.row + box.height - thickness), box.col,
+                   int16_t(thickness), box.width }, pixel };
+    fills[2] = { { int16_t(box.row + thickness), box.col,
+                   inner, int16_t(thickness) }, pixel };
+    fills[3] = { { int16_t(box.row + thickness),
+                   int16_t(box.col + box.width - thickness),
+                   inner, int16_t(thickness) }, pixel };
+    return 4;
+}
+
+
+// Write a sprite to screen.
+// Uncompressed data is sent directly. Compressed data is expanded into the
+// work buffer, sending that each time it fills. An empty sprite draws
+// nothing.
+void Ws24::write(uint16_t row, uint16_t col, const Sprite& sprite)
+{
+    if (sprite.height <= 0 || sprite.width <= 0)
+        return;
+
+    sync();
+
+    window(row, col, sprite.height, sprite.width);
+
+    if (!sprite.rle) {
+        write(memory_write, sprite.data, sprite.len * 2);
+        return;
+    }
+
+    uint8_t cmd_byte = memory_write;
+
+    const int work_pixels = _work_bytes / sizeof(uint16_t);
+    uint16_t *work_pix = (uint16_t *)scratch();
+    int cnt = 0; // pixels in work buffer
+
+    const uint16_t *data = sprite.data;
+    const uint16_t *end = data + sprite.len;
+    while (data < end) {
+        uint16_t n = *data++;
+        bool run = (n & 0x8000) != 0;
+        n &= 0x7fff;
+        while (n > 0) {
+            // room in work buffer
+            int m = work_pixels - cnt;
+            if (m > n)
+                m = n;
+            if (run) {
+                for (int i = 0; i < m; i++)
+                    work_pix[cnt + i] = *data;
+            } else {
+                memcpy(&work_pix[cnt], data, m * sizeof(uint16_t));
+                data += m;
+            }
+            cnt += m;
+            n -= m;
+            if (cnt == work_pixels) {
+                write(cmd_byte, _work, cnt * 2);
+                cmd_byte = memory_write_continue;
+                cnt = 0;
+            }
+        }
+        if (run)
+            data++;
+    }
+
+    if (cnt > 0)
+        write(cmd_byte, _work, cnt * 2);
 }
 
 
@@ -257,6 +449,30 @@ void Ws24::brightness(int br)
 }
 
 
+// define vertical scrolling area (physical lines)
+void Ws24::scroll_area(uint16_t top, uint16_t height, uint16_t bottom)
+{
+    sync();
+
+    uint8_t buf[6] = {
+        uint8_t(top >> 8), uint8_t(top),
+        uint8_t(height >> 8), uint8_t(height),
+        uint8_t(bottom >> 8), uint8_t(bottom)
+    };
+    write(vertical_scrolling_def, buf, sizeof(buf));
+}
+
+
+// set first line of scrolling area (physical line)
+void Ws24::scroll_start(uint16_t line)
+{
+    sync();
+
+    uint8_t buf[2] = { uint8_t(line >> 8), uint8_t(line) };
+    write(vertical_scroll_start, buf, sizeof(buf));
+}
+
+
 // print character to screen
 void Ws24::print(const Font& font, uint16_t row, uint16_t col,
                  Pixel fg, Pixel bg, char c)
@@ -264,14 +480,21 @@ void Ws24::print(const Font& font, uint16_t row, uint16_t col,
     if (c < 0 || c > 127)
         return;
 
+    // work buffer is about to be used
+    sync();
+
     // pixels we need for this particular glyph
     int num_pixels = font.y_adv * font.info[c].x_adv;
 
-    Pixel *pix_buf = (Pixel *)_work;
+    Pixel *pix_buf = (Pixel *)scratch();
     int pix_buf_len = _work_bytes / sizeof(Pixel);
 
-    if (num_pixels > pix_buf_len)
+    if (num_pixels > pix_buf_len) {
+        count_glyph(false);
         return;
+    }
+
+    uint32_t start = call_begin();
 
     // get rgb components of foreground/background; used for smoothing
     uint8_t fg_r, fg_g, fg_b;
@@ -326,6 +549,9 @@ void Ws24::print(const Font& font, uint16_t row, uint16_t col,
 
     // plop
     write(row, col, font.y_adv, font.info[c].x_adv, (Pixel *)_work);
+
+    count_glyph(true);
+    call_end(Ws24Call::print, start);
 }
 
 
@@ -333,11 +559,301 @@ void Ws24::print(const Font& font, uint16_t row, uint16_t col,
 void Ws24::print(const Font& font, uint16_t row, uint16_t col,
                  Pixel fg, Pixel bg, const char *str)
 {
+    uint32_t start = call_begin();
+
     while (*str != '\0') {
         char c = *str++;
         print(font, row, col, fg, bg, c);
         col += font.width(c);
     }
+
+    call_end(Ws24Call::print, start);
+}
+
+
+// Print string rotated.
+//
+// The text is drawn with the controller set up as if the screen had been
+// rotated the other way, so glyph rows are sent just as print() sends
+// them. Rotating the screen 90 clockwise makes what is drawn appear 90
+// counterclockwise, so text rotated clockwise by rotate is drawn in
+// orientation (screen rotation - rotate). row, col are converted from the
+// screen's orientation to that one through physical coordinates.
+void Ws24::print_rotated(const Font& font, uint16_t row, uint16_t col,
+                         int rotate, Pixel fg, Pixel bg, const char *str)
+{
+    rotate = ((rotate % 360) + 360) % 360;
+    if (rotate != 0 && rotate != 90 && rotate != 180 && rotate != 270)
+        return;
+
+    if (rotate == 0) {
+        print(font, row, col, fg, bg, str);
+        return;
+    }
+
+    const int text_rotate = (_rotate - rotate + 360) % 360;
+
+    // screen coordinates to physical
+    int py, px;
+    if (_rotate == 90) {
+        py = phy_height - 1 - col;
+        px = row;
+    } else if (_rotate == 180) {
+        py = phy_height - 1 - row;
+        px = phy_width - 1 - col;
+    } else if (_rotate == 270) {
+        py = col;
+        px = phy_width - 1 - row;
+    } else {
+        py = row;
+        px = col;
+    }
+
+    // physical to text orientation
+    int t_row, t_col;
+    if (text_rotate == 90) {
+        t_row = px;
+        t_col = phy_height - 1 - py;
+    } else if (text_rotate == 180) {
+        t_row = phy_height - 1 - py;
+        t_col = phy_width - 1 - px;
+    } else if (text_rotate == 270) {
+        t_row = phy_width - 1 - px;
+        t_col = py;
+    } else {
+        t_row = py;
+        t_col = px;
+    }
+
+    sync();
+
+    uint32_t start = call_begin();
+
+    write(memory_access_ctl, madctl(text_rotate));
+    print(font, t_row, t_col, fg, bg, str);
+    write(memory_access_ctl, madctl(_rotate));
+
+    call_end(Ws24Call::print, start);
+}
+
+
+// print string word-wrapped into box
+const char *Ws24::print(const Font& font, const Rect& box,
+                        Pixel fg, Pixel bg, const char *str, Align align)
+{
+    return print(font, box, box, fg, bg, str, align);
+}
+
+
+// print string word-wrapped into box, drawing only what is inside clip
+const char *Ws24::print(const Font& font, const Rect& box, const Rect& clip,
+                        Pixel fg, Pixel bg, const char *str, Align align)
+{
+    const Rect screen = { 0, 0, int16_t(_height), int16_t(_width) };
+    const int height = font.height();
+
+    uint32_t start = call_begin();
+
+    int row = box.row;
+    while (*str != '\0' && row + height <= box.row + box.height) {
+
+        int line_len, line_width;
+        const char *next = text_wrap(font, str, box.width,
+                                     &line_len, &line_width);
+
+        // whole line outside clip or screen is skipped after wrapping
+        if (clip.intersects(row, clip.col, height, clip.width) &&
+            screen.intersects(row, 0, height, screen.width)) {
+            int col = text_align(box.col, box.width, line_width, align);
+            for (int i = 0; i < line_len; i++) {
+                char c = str[i];
+                int w = font.width(c);
+                if (w > 0 && box.contains(row, col, height, w) &&
+                    clip.contains(row, col, height, w) &&
+                    screen.contains(row, col, height, w))
+                    print(font, row, col, fg, bg, c);
+                col += w;
+            }
+        }
+
+        row += height;
+        str = next;
+    }
+
+    call_end(Ws24Call::print, start);
+
+    return str;
+}
+
+
+// get counters, optionally resetting them
+void Ws24::stats(Ws24Stats& snapshot, bool reset)
+{
+#if WS24_STATS
+    snapshot = _stats;
+    if (reset)
+        stats_reset();
+#else
+    memset(&snapshot, 0, sizeof(snapshot));
+    (void)reset;
+#endif
+}
+
+
+// reset counters
+void Ws24::stats_reset()
+{
+#if WS24_STATS
+    memset(&_stats, 0, sizeof(_stats));
+#endif
+}
+
+
+// set trace callback
+void Ws24::trace(Ws24Trace fn, void *arg)
+{
+#if WS24_STATS
+    _trace_fn = fn;
+    _trace_arg = arg;
+#else
+    (void)fn;
+    (void)arg;
+#endif
+}
+
+
+// count one SPI transaction
+void Ws24::count_spi(int data_bytes)
+{
+#if WS24_STATS
+    _stats.transactions++;
+    _stats.cmd_bytes++;
+    _stats.data_bytes += data_bytes;
+#else
+    (void)data_bytes;
+#endif
+}
+
+
+// count glyph drawn or skipped
+void Ws24::count_glyph(bool drawn)
+{
+#if WS24_STATS
+    if (drawn)
+        _stats.glyphs++;
+    else
+        _stats.glyphs_skipped++;
+#else
+    (void)drawn;
+#endif
+}
+
+
+// start of timed call
+uint32_t Ws24::call_begin()
+{
+#if WS24_STATS
+    _stats_depth++;
+    return micros();
+#else
+    return 0;
+#endif
+}
+
+
+// end of timed call; only the outermost of nested calls is recorded
+void Ws24::call_end(Ws24Call call, uint32_t start_usec)
+{
+#if WS24_STATS
+    if (--_stats_depth > 0)
+        return;
+
+    uint32_t usec = micros() - start_usec;
+
+    // bucket is floor(log2(usec)), with 0 and 1 both in bucket 0
+    int bucket = 0;
+    for (uint32_t u = usec >> 1; u != 0 && bucket < Ws24Stats::num_buckets - 1; u >>= 1)
+        bucket++;
+    _stats.usec[int(call)][bucket]++;
+
+    if (_trace_fn != nullptr)
+        _trace_fn(_trace_arg, call, start_usec, usec);
+#else
+    (void)call;
+    (void)start_usec;
+#endif
+}
+
+
+// memory access control parameter for rotation (0, 90, 180, 270)
+uint8_t Ws24::madctl(int rotate)
+{
+    uint8_t param = 0x08;
+    if (rotate == 90)
+        param |= 0x60;
+    else if (rotate == 180)
+        param |= 0xc0;
+    else if (rotate == 270)
+        param |= 0xa0;
+    return param;
+}
+
+
+// finish anything queued on the bus for this display
+void Ws24::sync()
+{
+    if (_bus != nullptr)
+        _bus->flush(*this);
+}
+
+
+// set window for memory_write
+void Ws24::window(uint16_t row, uint16_t col, uint16_t height, uint16_t width)
+{
+    write(page_adrs_set, row, row + height - 1);
+    write(column_adrs_set, col, col + width - 1);
+}
+
+
+// Send count pixels of one color, first with cmd (memory_write or
+// memory_write_continue), then memory_write_continue. The work buffer is
+// filled with pixel and sent repeatedly until enough pixels have been sent.
+// It is sent without reading anything back, so it still holds pixel
+// afterwards; filling is skipped for as much of it as already does.
+void Ws24::send_fill(uint8_t cmd, Pixel pixel, uint32_t count)
+{
+    // work buffer, used to hold Pixels (two bytes each)
+    const uint32_t work_pixels = _work_bytes / sizeof(Pixel);
+    Pixel *work_pix = (Pixel *)_work;
+
+    // spi_pixels is minimum of pixels to send and work size in pixels
+    uint32_t spi_pixels = count;
+    if (spi_pixels > work_pixels)
+        spi_pixels = work_pixels;
+
+    // anyone (this or another display) writing a work buffer since the
+    // last fill may have overwritten this one
+    if (_fill_generation != _work_generation || pixel.raw() != _fill_pixel.raw())
+        _fill_count = 0;
+
+    if (_fill_count < spi_pixels) {
+        for (uint32_t i = _fill_count; i < spi_pixels; i++)
+            work_pix[i] = pixel;
+        _fill_pixel = pixel;
+        _fill_count = spi_pixels;
+        _fill_generation = ++_work_generation;
+    }
+
+    while (count > 0) {
+        uint32_t n = count;
+        if (n > spi_pixels)
+            n = spi_pixels;
+
+        write(cmd, (const void *)_work, n * 2);
+
+        count -= n;
+        cmd = memory_write_continue;
+    }
 }
 
 
@@ -355,6 +871,8 @@ void Ws24::hw_reset()
 // write command with no parameters to controller
 void Ws24::write(uint8_t cmd)
 {
+    count_spi(0);
+
     _spi.beginTransaction(_spi_settings);
     digitalWrite(_gpio_spi_cs, 0);
 
@@ -369,6 +887,8 @@ void Ws24::write(uint8_t cmd)
 // write command with one 8-bit parameter to controller
 void Ws24::write(uint8_t cmd, uint8_t p1)
 {
+    count_spi(sizeof(p1));
+
     _spi.beginTransaction(_spi_settings);
     digitalWrite(_gpio_spi_cs, 0);
 
@@ -386,6 +906,8 @@ void Ws24::write(uint8_t cmd, uint8_t p1)
 // write command with two 16-bit parameters to controller
 void Ws24::write(uint8_t cmd, uint16_t p1, uint16_t p2)
 {
+    count_spi(4);
+
     _spi.beginTransaction(_spi_settings);
     digitalWrite(_gpio_spi_cs, 0);
 
@@ -408,6 +930,8 @@ void Ws24::write(uint8_t cmd, void *buf, int buf_len)
 {
     // buf is overwritten
 
+    count_spi(buf_len);
+
     _spi.beginTransaction(_spi_settings);
     digitalWrite(_gpio_spi_cs, 0);
 
@@ -422,22 +946,46 @@ void Ws24::write(uint8_t cmd, void *buf, int buf_len)
 }
 
 
+// write command with arbitrary parameters to controller
+void Ws24::write(uint8_t cmd, const void *buf, int buf_len)
+{
+    // buf is not modified; nothing is received (arduino-pico's SPIClass
+    // accepts a null receive buffer), so buf can be in flash
+
+    count_spi(buf_len);
+
+    _spi.beginTransaction(_spi_settings);
+    digitalWrite(_gpio_spi_cs, 0);
+
+    digitalWrite(_gpio_dc, 0);
+    _spi.transfer(cmd);
+
+    digitalWrite(_gpio_dc, 1);
+    _spi.transfer(buf, nullptr, buf_len);
+
+    digitalWrite(_gpio_spi_cs, 1);
+    _spi.endTransaction();
+}
+
+
 // initialize 16-bit to 18-bit color mapping in controller
 bool Ws24::init_colors()
 {
     if (_work_bytes < 128)
         return false;
 
+    uint8_t *work = scratch();
+
     for (int red = 0; red < 32; red++)
-        _work[red] = red << 1;
+        work[red] = red << 1;
 
     for (int grn = 0; grn < 64; grn++)
-        _work[32 + grn] = grn;
+        work[32 + grn] = grn;
 
     for (int blu = 0; blu < 32; blu++)
-        _work[96 + blu] = blu << 1;
+        work[96 + blu] = blu << 1;
 
-    write(color_set, _work, 128);
+    write(color_set, work, 128);
 
     return true;
 }
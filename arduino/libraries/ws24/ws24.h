@@ -2,9 +2,22 @@
 
 #include <SPI.h>
 #include <stdint.h>
+#include "font.h"
+#include "layout.h"
 
 
-struct Font;
+// Define WS24_STATS as 1 (here or on the compiler command line) to keep
+// counts of SPI traffic and glyphs, and a histogram of how long public
+// calls take. With it 0, all the counting is compiled out, and stats()
+// returns zeros. Only ws24.cpp looks at it; class Ws24 is the same either
+// way, so code built with a different setting still links with it.
+#ifndef WS24_STATS
+#define WS24_STATS 0
+#endif
+
+
+struct Sprite;
+class Ws24Bus;
 
 
 // An RGB pixel is sent to the display in two bytes: 5 bits red, 6 bits green,
@@ -58,6 +71,50 @@ class Pixel {
 };
 
 
+// A rectangle to fill with a solid color, for Ws24::fill()
+struct Fill {
+    Rect rect;
+    Pixel pixel;
+};
+
+
+// Put the edges of box, thickness pixels wide and inside box, in fills[]
+// (room for 4): top and bottom full width, left and right between them.
+// Returns the number of fills; 1 if box is too small to have a hole, 0 if
+// box is empty or thickness < 1.
+int frame_fills(Fill *fills, const Rect& box, int thickness, Pixel pixel);
+
+
+// public calls that are timed
+enum class Ws24Call : uint8_t { print, fill, pixels };
+
+
+// Counters, since construction or the last reset
+struct Ws24Stats {
+    // SPI transactions (one command each), and bytes sent
+    uint32_t transactions;
+    uint32_t cmd_bytes;
+    uint32_t data_bytes;
+
+    // glyphs drawn, and not drawn because the work buffer is too small
+    uint32_t glyphs;
+    uint32_t glyphs_skipped;
+
+    // Histogram of call times, indexed by Ws24Call. Bucket 0 counts calls
+    // taking less than 2 usec, bucket n counts 2^n to 2^(n+1)-1 usec, and
+    // the last bucket counts everything longer. Nested calls (e.g. the
+    // pixel write done by a print) are not counted separately.
+    static const int num_calls = 3;
+    static const int num_buckets = 16;
+    uint32_t usec[num_calls][num_buckets];
+};
+
+
+// Called at the end of each timed call, if set with Ws24::trace()
+typedef void (*Ws24Trace)(void *arg, Ws24Call call,
+                          uint32_t start_usec, uint32_t usec);
+
+
 class Ws24 {
 
     public:
@@ -86,6 +143,25 @@ class Ws24 {
                    uint16_t height, uint16_t width,
                    Pixel pixel); // one Pixel to fill rectangle
 
+        // Fill a batch of rectangles, each with its own color. The result
+        // is the same as filling them one at a time in the order given.
+        //
+        // fills[] is reordered: by color, so the work buffer is filled once
+        // per color, then by column, so rectangles sharing columns or rows
+        // skip that part of the window setup. A rectangle is never moved
+        // ahead of an earlier one it overlaps in a different color, so a
+        // background and the frame or text boxes on it can go in one batch.
+        // Rectangles of one color stacked exactly on top of each other are
+        // sent as one. Rectangles are clipped to the screen.
+        void fill(Fill *fills, int count);
+
+        // draw the edges of box, thickness pixels wide, inside box
+        void frame(const Rect& box, int thickness, Pixel pixel);
+
+        // write a pre-rendered sprite to screen
+        // uncompressed sprites are sent straight from where they are (flash)
+        void write(uint16_t row, uint16_t col, const Sprite& sprite);
+
         // set backlight brightness (0..255)
         void brightness(int br);
 
@@ -93,6 +169,18 @@ class Ws24 {
         uint16_t height() const { return _height; }
         uint16_t width() const { return _width; }
 
+        // rotation given to begin(), normalized to 0, 90, 180, or 270
+        int rotation() const { return _rotate; }
+
+        // Define the hardware vertical scrolling area. All arguments are in
+        // physical lines (portrait, ribbon cable at bottom), and must add up
+        // to phy_height (320): top fixed, scrolling, bottom fixed.
+        void scroll_area(uint16_t top, uint16_t height, uint16_t bottom);
+
+        // Set the frame memory line shown at the top of the scrolling area.
+        // Also in physical lines, top <= line < top + height.
+        void scroll_start(uint16_t line);
+
         // print character to display
         void print(const Font& font, uint16_t row, uint16_t col,
                    Pixel fg, Pixel bg, char c);
@@ -101,8 +189,54 @@ class Ws24 {
         void print(const Font& font, uint16_t row, uint16_t col,
                    Pixel fg, Pixel bg, const char *str);
 
+        // Print character or string with a font described at compile time
+        // (make_font -d writes <font>_desc), e.g.
+        //     lcd.print<consolas_24_desc>(row, col, fg, bg, "text");
+        // Same result as print(), but fixed-width fonts get a fixed box
+        // size, and cropping is left out where the font needs none.
+        template <typename FontT>
+        void print(uint16_t row, uint16_t col, Pixel fg, Pixel bg, char c);
+
+        template <typename FontT>
+        void print(uint16_t row, uint16_t col, Pixel fg, Pixel bg,
+                   const char *str);
+
+        // Print string rotated clockwise by rotate (0, 90, 180, 270, -90)
+        // from the screen's orientation, e.g. 90 reads top to bottom. row,
+        // col is where the first character's top left corner goes, as seen
+        // reading the text (for 90, that is the text's top right corner
+        // on the screen). Costs the same as print(), plus two commands.
+        // Not for use with hardware scrolling (Console).
+        void print_rotated(const Font& font, uint16_t row, uint16_t col,
+                           int rotate, Pixel fg, Pixel bg, const char *str);
+
+        // Print string word-wrapped into box, each line aligned in the box.
+        // Only character boxes entirely inside both box and clip (and the
+        // screen) are drawn; the rest are skipped without rendering. Lines
+        // that do not fit in box are not drawn, and where they start is
+        // returned (pointing at the '\0' if everything fit).
+        const char *print(const Font& font, const Rect& box,
+                          Pixel fg, Pixel bg, const char *str,
+                          Align align=Align::left);
+
+        const char *print(const Font& font, const Rect& box, const Rect& clip,
+                          Pixel fg, Pixel bg, const char *str,
+                          Align align=Align::left);
+
+        // get counters, optionally resetting them
+        void stats(Ws24Stats& snapshot, bool reset=false);
+
+        // reset counters
+        void stats_reset();
+
+        // Call fn(arg, ...) at the end of each timed call; fn=nullptr to
+        // stop. Only works with WS24_STATS.
+        void trace(Ws24Trace fn, void *arg=nullptr);
+
     private:
 
+        friend class Ws24Bus;
+
         // ILI9341 command bytes
         static const uint8_t sleep_out = 0x11;
         static const uint8_t gamma_set = 0x26;
@@ -111,7 +245,9 @@ class Ws24 {
         static const uint8_t page_adrs_set = 0x2b;
         static const uint8_t memory_write = 0x2c;
         static const uint8_t color_set = 0x2d;
+        static const uint8_t vertical_scrolling_def = 0x33;
         static const uint8_t memory_access_ctl = 0x36;
+        static const uint8_t vertical_scroll_start = 0x37;
         static const uint8_t pixel_format_set = 0x3a;
         static const uint8_t memory_write_continue = 0x3c;
         static const uint8_t set_tear_scanline = 0x44;
@@ -153,6 +289,9 @@ class Ws24 {
         uint16_t _height;
         uint16_t _width;
 
+        // 0, 90, 180, or 270
+        int _rotate;
+
         // Work buffer used in a few places:
         // * initializing colors lut (must be at least 128 bytes)
         // * filling rectangles on screen (any size is okay, but bigger means
@@ -162,12 +301,148 @@ class Ws24 {
         uint8_t *_work;
         int _work_bytes;
 
+        // The first _fill_count pixels of the work buffer hold _fill_pixel,
+        // left there by send_fill() so the next fill of that color does not
+        // refill it. Work buffers may be shared between displays, so this
+        // only holds while no one has written to any work buffer since:
+        // every write bumps _work_generation (send_fill() directly, all
+        // other uses through scratch()), and the cache is good only while
+        // _fill_generation matches it.
+        Pixel _fill_pixel;
+        uint32_t _fill_count;
+        uint32_t _fill_generation;
+        static uint32_t _work_generation;
+
+        uint8_t *scratch()
+        {
+            _work_generation++;
+            return _work;
+        }
+
+        // set by Ws24Bus::add() if this display's work can be queued
+        Ws24Bus *_bus;
+
         void hw_reset();
 
+        static uint8_t madctl(int rotate);
+
+        void sync();
+        void window(uint16_t row, uint16_t col, uint16_t height, uint16_t width);
+        void send_fill(uint8_t cmd, Pixel pixel, uint32_t count);
+        static bool fill_before(const Fill& a, const Fill& b);
+        static bool fill_overlap(const Fill& a, const Fill& b);
+
         void write(uint8_t cmd);
         void write(uint8_t cmd, uint8_t p1);
         void write(uint8_t cmd, uint16_t p1, uint16_t p2);
         void write(uint8_t cmd, void *buf, int buf_len);
+        void write(uint8_t cmd, const void *buf, int buf_len);
 
         bool init_colors();
+
+        // unused (all zero) without WS24_STATS
+        Ws24Stats _stats;
+        int _stats_depth; // of nested timed calls
+        Ws24Trace _trace_fn;
+        void *_trace_arg;
+
+        // count one SPI transaction
+        void count_spi(int data_bytes);
+
+        // count glyph drawn or skipped
+        void count_glyph(bool drawn);
+
+        // Start of timed call, returns start time to pass to call_end().
+        // Only the outermost of nested calls is recorded, so a string or
+        // a box of text is one print, however many glyphs it draws.
+        uint32_t call_begin();
+        void call_end(Ws24Call call, uint32_t start_usec);
 };
+
+
+// print character, specialized for font
+template <typename FontT>
+void Ws24::print(uint16_t row, uint16_t col, Pixel fg, Pixel bg, char c)
+{
+    static_assert(FontT::bpp == 8, "only 8-bit glyph data is supported");
+
+    const Font& font = FontT::font();
+
+    if (c < 0 || c > 127 || font.info[c].off < 0)
+        return;
+
+    // work buffer is about to be used
+    sync();
+
+    const int height = FontT::height;
+    const int x_adv =
+        (FontT::cell_width > 0) ? FontT::cell_width : font.info[c].x_adv;
+
+    Pixel *pix_buf = (Pixel *)scratch();
+
+    if (height * x_adv > int(_work_bytes / sizeof(Pixel))) {
+        count_glyph(false);
+        return;
+    }
+
+    uint32_t start = call_begin();
+
+    // same interpolation as print()
+    uint8_t fg_r, fg_g, fg_b;
+    fg.rgb(fg_r, fg_g, fg_b);
+    uint8_t bg_r, bg_g, bg_b;
+    bg.rgb(bg_r, bg_g, bg_b);
+    const int d_r = (int)fg_r - (int)bg_r;
+    const int d_g = (int)fg_g - (int)bg_g;
+    const int d_b = (int)fg_b - (int)bg_b;
+
+    const uint8_t *gs = font.data + font.info[c].off;
+    const int x_off = font.info[c].x_off;
+    const int y_off = font.info[c].y_off;
+    const int w = font.info[c].w;
+    const int h = font.info[c].h;
+
+    // fill box with background
+    for (int i = 0; i < height * x_adv; i++)
+        pix_buf[i] = bg;
+
+    // put glyph in box, cropping only if the font needs it
+    for (int g_row = 0; g_row < h; g_row++) {
+        const int p_row = g_row + y_off;
+        if (!FontT::rows_inside && (p_row < 0 || p_row >= height))
+            continue;
+        const int base = p_row * x_adv + x_off;
+        for (int g_col = 0; g_col < w; g_col++) {
+            if (!FontT::cols_inside &&
+                (g_col + x_off < 0 || g_col + x_off >= x_adv))
+                continue;
+            uint8_t gray = gs[g_row * w + g_col];
+            uint8_t r = bg_r + d_r * gray / 255;
+            uint8_t g = bg_g + d_g * gray / 255;
+            uint8_t b = bg_b + d_b * gray / 255;
+            pix_buf[base + g_col] = Pixel(r, g, b);
+        }
+    }
+
+    write(row, col, height, x_adv, pix_buf);
+
+    count_glyph(true);
+    call_end(Ws24Call::print, start);
+}
+
+
+// print string, specialized for font
+template <typename FontT>
+void Ws24::print(uint16_t row, uint16_t col, Pixel fg, Pixel bg,
+                 const char *str)
+{
+    uint32_t start = call_begin();
+
+    while (*str != '\0') {
+        char c = *str++;
+        print<FontT>(row, col, fg, bg, c);
+        col += FontT::font().width(c);
+    }
+
+    call_end(Ws24Call::print, start);
+}
@@ -0,0 +1,249 @@
+#include <Arduino.h>
+#include <cstdint>
+#include "sprite.h"
+#include "ws24.h"
+#include "ws24_bus.h"
+
+
+Ws24Bus::Ws24Bus(uint32_t slice_pixels) :
+    _slice_pixels(slice_pixels),
+    _num_panels(0),
+    _last(-1),
+    _seq(0)
+{
+    for (int i = 0; i < max_panels; i++)
+        _panels[i] = nullptr;
+    for (int i = 0; i < max_jobs; i++)
+        _jobs[i].panel = nullptr;
+}
+
+
+Ws24Bus::~Ws24Bus()
+{
+    flush();
+    for (int i = 0; i < _num_panels; i++)
+        _panels[i]->_bus = nullptr;
+}
+
+
+// add a display
+bool Ws24Bus::add(Ws24& panel)
+{
+    if (panel_index(panel) >= 0)
+        return true;
+    if (_num_panels >= max_panels)
+        return false;
+    _panels[_num_panels++] = &panel;
+    panel._bus = this;
+    return true;
+}
+
+
+// finish display's jobs and forget it
+void Ws24Bus::remove(Ws24& panel)
+{
+    int p = panel_index(panel);
+    if (p < 0)
+        return;
+
+    flush(panel);
+
+    _num_panels--;
+    for (int i = p; i < _num_panels; i++)
+        _panels[i] = _panels[i + 1];
+    _panels[_num_panels] = nullptr;
+
+    // the display after the removed one still goes next if it was due
+    if (_last >= p)
+        _last--;
+    if (_num_panels == 0)
+        _last = -1;
+
+    panel._bus = nullptr;
+}
+
+
+// queue a fill
+void Ws24Bus::write(Ws24& panel, uint16_t row, uint16_t col,
+                    uint16_t height, uint16_t width, Pixel pixel,
+                    int priority)
+{
+    if (height == 0 || width == 0)
+        return;
+    Job *job = queue(panel, priority);
+    if (job == nullptr) {
+        panel.write(row, col, height, width, pixel);
+        return;
+    }
+    job->row = row;
+    job->col = col;
+    job->height = height;
+    job->width = width;
+    job->pixel = pixel;
+    job->data = nullptr;
+    job->remaining = (uint32_t)(height) * (uint32_t)(width);
+}
+
+
+// queue a sprite
+void Ws24Bus::write(Ws24& panel, uint16_t row, uint16_t col,
+                    const Sprite& sprite, int priority)
+{
+    if (sprite.height <= 0 || sprite.width <= 0 || sprite.len == 0)
+        return;
+    if (sprite.rle) {
+        panel.write(row, col, sprite); // waits for anything queued
+        return;
+    }
+    Job *job = queue(panel, priority);
+    if (job == nullptr) {
+        panel.write(row, col, sprite);
+        return;
+    }
+    job->row = row;
+    job->col = col;
+    job->height = sprite.height;
+    job->width = sprite.width;
+    job->data = sprite.data;
+    job->remaining = sprite.len;
+}
+
+
+// send one slice
+bool Ws24Bus::poll()
+{
+    // of the displays' first jobs, pick the highest priority, taking turns
+    // starting after the display that went last
+    Job *next = nullptr;
+    int next_panel = -1;
+    for (int n = 1; n <= _num_panels; n++) {
+        int p = (_last + n) % _num_panels;
+        Job *job = head(*_panels[p]);
+        if (job != nullptr && (next == nullptr || job->priority > next->priority)) {
+            next = job;
+            next_panel = p;
+        }
+    }
+
+    if (next == nullptr)
+        return false;
+
+    _last = next_panel;
+    run(*next);
+
+    return busy();
+}
+
+
+// finish everything queued for one display
+void Ws24Bus::flush(Ws24& panel)
+{
+    Job *job;
+    while ((job = head(panel)) != nullptr)
+        run(*job);
+}
+
+
+// finish everything queued
+void Ws24Bus::flush()
+{
+    while (poll())
+        ;
+}
+
+
+// anything queued for display
+bool Ws24Bus::busy(const Ws24& panel) const
+{
+    for (int i = 0; i < max_jobs; i++)
+        if (_jobs[i].panel == &panel)
+            return true;
+    return false;
+}
+
+
+// anything queued
+bool Ws24Bus::busy() const
+{
+    for (int i = 0; i < max_jobs; i++)
+        if (_jobs[i].panel != nullptr)
+            return true;
+    return false;
+}
+
+
+// Get a free job slot for panel, sending slices until there is one.
+// Returns nullptr if panel was not added; caller draws directly then.
+Ws24Bus::Job *Ws24Bus::queue(Ws24& panel, int priority)
+{
+    if (panel_index(panel) < 0)
+        return nullptr;
+
+    while (true) {
+        for (int i = 0; i < max_jobs; i++) {
+            Job& job = _jobs[i];
+            if (job.panel != nullptr)
+                continue;
+            job.panel = &panel;
+            job.seq = _seq++;
+            job.priority = priority;
+            job.started = false;
+            return &job;
+        }
+        poll();
+    }
+}
+
+
+// oldest job for panel, or nullptr
+Ws24Bus::Job *Ws24Bus::head(const Ws24& panel)
+{
+    Job *oldest = nullptr;
+    for (int i = 0; i < max_jobs; i++) {
+        Job& job = _jobs[i];
+        if (job.panel != &panel)
+            continue;
+        // seq differences work across wraparound
+        if (oldest == nullptr || int32_t(job.seq - oldest->seq) < 0)
+            oldest = &job;
+    }
+    return oldest;
+}
+
+
+int Ws24Bus::panel_index(const Ws24& panel) const
+{
+    for (int i = 0; i < _num_panels; i++)
+        if (_panels[i] == &panel)
+            return i;
+    return -1;
+}
+
+
+// send one slice of job, freeing it when done
+void Ws24Bus::run(Job& job)
+{
+    Ws24& panel = *job.panel;
+
+    uint8_t cmd = Ws24::memory_write_continue;
+    if (!job.started) {
+        panel.window(job.row, job.col, job.height, job.width);
+        cmd = Ws24::memory_write;
+        job.started = true;
+    }
+
+    uint32_t pixels = job.remaining;
+    if (pixels > _slice_pixels)
+        pixels = _slice_pixels;
+
+    if (job.data == nullptr) {
+        panel.send_fill(cmd, job.pixel, pixels);
+    } else {
+        panel.write(cmd, (const void *)job.data, pixels * 2);
+        job.data += pixels;
+    }
+
+    job.remaining -= pixels;
+    if (job.remaining == 0)
+        job.panel = nullptr;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include "ws24.h"
+
+
+struct Sprite;
+
+
+// Schedules drawing for several Ws24 displays sharing one SPI bus (each
+// with its own chip select).
+//
+// Big jobs (rectangle fills, sprites) are queued here instead of being
+// sent all at once. poll() sends one slice of the job that should go next,
+// where a slice is at most slice_pixels pixels: the first with
+// memory_write, the rest with memory_write_continue. Between slices, any
+// display can be drawn on, so a large fill on one display only holds up
+// a small update on another for one slice.
+//
+// Each display keeps its own window and memory pointer while it is not
+// selected, so slices for different displays can be interleaved. Jobs for
+// one display are always done in the order they were queued. Drawing
+// directly on a display (print, write, etc.) first finishes anything
+// queued for it, so everything on one display happens in order.
+//
+// The job that goes next is the one with the highest priority, of those
+// at the head of each display's queue. Displays with the same priority
+// take turns.
+//
+// Fills use the display's own work buffer; sprites are sent from where
+// they are. Compressed sprites are not queued, they are drawn right away.
+
+class Ws24Bus {
+
+    public:
+
+        // slice_pixels = most pixels sent at once for a queued job
+        Ws24Bus(uint32_t slice_pixels=1024);
+
+        virtual ~Ws24Bus();
+
+        // add a display; returns false if there are too many
+        bool add(Ws24& panel);
+
+        // finish everything queued for a display and stop scheduling it
+        // (a display does this itself when destroyed)
+        void remove(Ws24& panel);
+
+        // Queue a fill or a sprite. If the queue is full, slices are sent
+        // until there is room. Empty ones are dropped.
+        void write(Ws24& panel, uint16_t row, uint16_t col,
+                   uint16_t height, uint16_t width, Pixel pixel,
+                   int priority=0);
+
+        void write(Ws24& panel, uint16_t row, uint16_t col,
+                   const Sprite& sprite, int priority=0);
+
+        // Send one slice. Returns true if there is more to do.
+        bool poll();
+
+        // finish everything queued for one display, or all of them
+        void flush(Ws24& panel);
+        void flush();
+
+        // anything queued for one display, or any of them
+        bool busy(const Ws24& panel) const;
+        bool busy() const;
+
+    private:
+
+        static const int max_panels = 4;
+        static const int max_jobs = 8;
+
+        struct Job {
+            Ws24 *panel;        // nullptr if slot is free
+            uint32_t seq;       // order queued
+            int priority;
+            bool started;       // memory_write sent
+            uint16_t row;
+            uint16_t col;
+            uint16_t height;
+            uint16_t width;
+            Pixel pixel;            // fill
+            const uint16_t *data;   // sprite, or nullptr for fill
+            uint32_t remaining;     // pixels
+        };
+
+        uint32_t _slice_pixels;
+
+        Ws24 *_panels[max_panels];
+        int _num_panels;
+
+        // panel that got the last slice, for taking turns
+        int _last;
+
+        Job _jobs[max_jobs];
+        uint32_t _seq;
+
+        Job *queue(Ws24& panel, int priority);
+        Job *head(const Ws24& panel);
+        int panel_index(const Ws24& panel) const;
+        void run(Job& job);
+};
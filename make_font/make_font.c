@@ -1,9 +1,14 @@
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 #include <png.h>
 
 
@@ -32,97 +37,615 @@ png_uint_32 image_width = 0;
 // total bytes of grayscale data we need in output for all glyphs
 int gs_bytes;
 
+// coverage curve, applied to every grayscale value as it is read from the
+// png (identity unless -g, -c or -w is given)
+uint8_t coverage[256];
+
+// description of the curve for the generated code, empty if identity
+char coverage_note[120];
+
+
+// build the coverage curve
+//
+// Ws24::print() blends bg + (fg - bg) * gray / 255 directly on gamma-encoded
+// RGB565, so partially covered pixels come out too dim for light text on a
+// dark background and too heavy for dark text on a light background. Baking
+// the correction into the glyph data costs nothing at runtime.
+//
+// Applied in this order to v = gray / 255:
+//   darken    v = min(1, v * (1 + darken)), stem darkening; thickens thin
+//             strokes by boosting partial coverage
+//   contrast  v = v^k / (v^k + (1 - v)^k), S-curve through 0, 1/2 and 1;
+//             k > 1 sharpens edges, k < 1 softens them
+//   gamma     v = v^(1/gamma) for light text on dark, or
+//             v = 1 - (1 - v)^(1/gamma) for dark text on light (inverted);
+//             gamma = 2.2 makes the blend linear-light for white on black
+//             (or black on white)
+//
+// 0 and 255 map to themselves, so background pixels stay background.
+static void make_coverage(double gamma, double contrast, double darken, int inverted)
+{
+    for (int i = 0; i < 256; i++) {
+        double v = i / 255.0;
+
+        if (darken != 0.0) {
+            v *= (1.0 + darken);
+            if (v > 1.0)
+                v = 1.0;
+        }
+
+        if (contrast != 1.0 && v > 0.0 && v < 1.0) {
+            double a = pow(v, contrast);
+            double b = pow(1.0 - v, contrast);
+            v = a / (a + b);
+        }
+
+        if (gamma != 1.0) {
+            if (inverted)
+                v = 1.0 - pow(1.0 - v, 1.0 / gamma);
+            else
+                v = pow(v, 1.0 / gamma);
+        }
+
+        coverage[i] = (uint8_t)(v * 255.0 + 0.5);
+    }
+
+    coverage_note[0] = '\0';
+    if (gamma != 1.0 || contrast != 1.0 || darken != 0.0)
+        snprintf(coverage_note, sizeof(coverage_note),
+                 "gamma %.2f (%s), contrast %.2f, darken %.2f",
+                 gamma, inverted ? "dark on light" : "light on dark",
+                 contrast, darken);
+}
+
 
-// skip line in description file
-static void skip_line(FILE *fp)
+// BMFont description, in any of the three formats BMFont writes: text,
+// XML, or binary (version 3).
+//
+// The whole .fnt is read into memory and parsed in one pass. Text lines
+// and XML elements are split into a record (tag and attributes, pointing
+// into the buffer) and handled the same way; attributes may come in any
+// order, unknown ones are ignored, and CRLF line endings are fine.
+// Characters outside 0..127 are counted and skipped.
+
+// attributes kept per record; BMFont writes at most 15
+#define FNT_ATTRS 32
+
+struct FntRecord {
+    const char *tag;
+    int tag_len;
+    int num_attrs;
+    struct {
+        const char *key;
+        int key_len;
+        const char *val;
+        int val_len;
+    } attr[FNT_ATTRS];
+};
+
+// file being read, for error messages
+static const char *fnt_fn;
+static const char *fnt_buf;
+static int fnt_binary;
+
+// page 0 png, found through the description
+char page_fn[FILENAME_MAX];
+
+// counted but not used
+int chars_skipped;
+int kernings;
+
+
+// report error at position at in the .fnt (NULL if none) and exit
+static void fnt_error(const char *at, const char *fmt, ...)
 {
-    char line[200];
-    memset(line, 0, sizeof(line));
-    assert(fgets(line, sizeof(line), fp) == line);
-    int len = strlen(line);
-    assert(line[len - 1] == '\n');
+    fprintf(stderr, "%s", fnt_fn);
+    if (at != NULL && fnt_binary) {
+        fprintf(stderr, ": offset %ld", (long)(at - fnt_buf));
+    } else if (at != NULL) {
+        int line = 1;
+        for (const char *p = fnt_buf; p < at; p++)
+            if (*p == '\n')
+                line++;
+        fprintf(stderr, ":%d", line);
+    }
+    fprintf(stderr, ": ");
+
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "\n");
+    exit(1);
 }
 
 
-// read BMFont description file
-static void read_description(const char *fn_root)
+// root followed by suffix, in buf[FILENAME_MAX]
+static const char *file_name(char *buf, const char *root, const char *suffix)
 {
-    char fn_buf[80];
-    sprintf(fn_buf, "%s.fnt", fn_root);
-    FILE *fp = fopen(fn_buf, "r");
-    assert(fp != NULL);
+    if (snprintf(buf, FILENAME_MAX, "%s%s", root, suffix) >= FILENAME_MAX) {
+        fprintf(stderr, "%s%s: file name too long\n", root, suffix);
+        exit(1);
+    }
+    return buf;
+}
 
-    memset(&glyph_info, 0, sizeof(glyph_info));
 
-    // "info" line
-    skip_line(fp);
+// read whole file into a '\0'-terminated buffer (free() it)
+static char *read_file(const char *fn, long *len)
+{
+    FILE *fp = fopen(fn, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", fn, strerror(errno));
+        exit(1);
+    }
 
-    // "common" line
-    int base;
-    assert(fscanf(fp, "common lineHeight=%d base=%d", &glyph_info.y_adv, &base) == 2);
-    skip_line(fp);
+    char *buf = NULL;
+    if (fseek(fp, 0, SEEK_END) == 0 && (*len = ftell(fp)) >= 0 &&
+        fseek(fp, 0, SEEK_SET) == 0 && (buf = malloc(*len + 1)) != NULL &&
+        fread(buf, 1, *len, fp) == (size_t)*len) {
+        buf[*len] = '\0';
+    } else {
+        fprintf(stderr, "%s: read error\n", fn);
+        exit(1);
+    }
 
-    // "page" line
-    skip_line(fp); // assuming page 0
+    fclose(fp);
 
-    int glyph_cnt;
-    assert(fscanf(fp, "chars count=%d\n", &glyph_cnt) == 1);
+    return buf;
+}
 
-    // glyph's offset = -1 means it is not present
-    for (int i = 0; i < 128; i++)
-        glyph_info.glyph[i].off = -1;
 
-    // initialize mins/maxs
-    glyph_info.x_adv_max = INT8_MIN;
-    glyph_info.x_off_min = INT8_MAX;
-    glyph_info.x_off_max = INT8_MIN;
-    glyph_info.y_off_min = INT8_MAX;
-    glyph_info.y_off_max = INT8_MIN;
+// part of a tag, key, or unquoted value (signed chars are UTF-8 bytes)
+static int fnt_word_char(char c)
+{
+    return (unsigned char)c > ' ' && c != '=' && c != '/' && c != '>' &&
+           c != '"';
+}
 
-    gs_bytes = 0;
-    for (int i = 0; i < glyph_cnt; i++) {
-        int c; // character
 
-        // read character id, used to index into glyph info
-        assert(fscanf(fp, "char id=%d\n", &c) == 1);
-        assert(c >= 0 && c < 128);
+static int fnt_is(const char *s, int len, const char *word)
+{
+    return (int)strlen(word) == len && memcmp(s, word, len) == 0;
+}
 
-        // read glyph info
-        assert(fscanf(fp, "x=%d y=%d width=%d height=%d xoffset=%d yoffset=%d xadvance=%d",
-                      &glyph_info.glyph[c].x, &glyph_info.glyph[c].y,
-                      &glyph_info.glyph[c].w, &glyph_info.glyph[c].h,
-                      &glyph_info.glyph[c].x_off, &glyph_info.glyph[c].y_off,
-                      &glyph_info.glyph[c].x_adv) == 7);
 
-        // skip over page and chnl
-        skip_line(fp);
+// value of attribute key, NULL if not there
+static const char *fnt_attr(const struct FntRecord *rec, const char *key,
+                            int *len)
+{
+    for (int i = 0; i < rec->num_attrs; i++) {
+        if (fnt_is(rec->attr[i].key, rec->attr[i].key_len, key)) {
+            *len = rec->attr[i].val_len;
+            return rec->attr[i].val;
+        }
+    }
+    return NULL;
+}
 
-        // where in the glyph data array this one is
-        glyph_info.glyph[c].off = gs_bytes;
 
-        // updates mins/maxs
-        if (glyph_info.x_adv_max < glyph_info.glyph[c].x_adv)
-            glyph_info.x_adv_max = glyph_info.glyph[c].x_adv;
+// integer value of attribute key; def if not there, or an error if def
+// is NULL
+static int fnt_int(const struct FntRecord *rec, const char *key,
+                   const int *def)
+{
+    int len;
+    const char *val = fnt_attr(rec, key, &len);
+    if (val == NULL) {
+        if (def == NULL)
+            fnt_error(rec->tag, "%.*s: no %s", rec->tag_len, rec->tag, key);
+        return *def;
+    }
 
-        if (glyph_info.x_off_min > glyph_info.glyph[c].x_off)
-            glyph_info.x_off_min = glyph_info.glyph[c].x_off;
+    int i = 0;
+    int neg = 0;
+    if (i < len && (val[i] == '-' || val[i] == '+'))
+        neg = (val[i++] == '-');
+    if (i == len)
+        fnt_error(val, "%.*s: %s is not a number", rec->tag_len, rec->tag, key);
+    long v = 0;
+    for (; i < len; i++) {
+        if (val[i] < '0' || val[i] > '9')
+            fnt_error(val, "%.*s: %s is not a number", rec->tag_len, rec->tag, key);
+        int digit = val[i] - '0';
+        if (v > (INT32_MAX - digit) / 10)
+            fnt_error(val, "%.*s: %s is out of range", rec->tag_len, rec->tag, key);
+        v = v * 10 + digit;
+    }
+    return neg ? -v : v;
+}
 
-        // x_off_max is really the max of (x_off + w), to see how far the
-        // glyph might extend, similar for y_off_max
-        if (glyph_info.x_off_max < (glyph_info.glyph[c].x_off + glyph_info.glyph[c].w))
-            glyph_info.x_off_max = glyph_info.glyph[c].x_off + glyph_info.glyph[c].w;
 
-        if (glyph_info.y_off_min > glyph_info.glyph[c].y_off)
-            glyph_info.y_off_min = glyph_info.glyph[c].y_off;
+static void add_attr(struct FntRecord *rec, const char *key, int key_len,
+                     const char *val, int val_len)
+{
+    if (rec->num_attrs == FNT_ATTRS)
+        return;
+    rec->attr[rec->num_attrs].key = key;
+    rec->attr[rec->num_attrs].key_len = key_len;
+    rec->attr[rec->num_attrs].val = val;
+    rec->attr[rec->num_attrs].val_len = val_len;
+    rec->num_attrs++;
+}
 
-        if (glyph_info.y_off_max < (glyph_info.glyph[c].y_off + glyph_info.glyph[c].h))
-            glyph_info.y_off_max = glyph_info.glyph[c].y_off + glyph_info.glyph[c].h;
 
-        // total bytes required in the glyph data array
-        gs_bytes += (glyph_info.glyph[c].w * glyph_info.glyph[c].h);
+// Split the text-format line at p into rec. Returns the start of the next
+// line.
+static const char *fnt_text_record(const char *p, struct FntRecord *rec)
+{
+    rec->num_attrs = 0;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+    rec->tag = p;
+    while (fnt_word_char(*p))
+        p++;
+    rec->tag_len = p - rec->tag;
+
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+            p++;
+        if (*p == '\n')
+            return p + 1;
+        if (*p == '\0')
+            return p;
+
+        const char *key = p;
+        while (fnt_word_char(*p))
+            p++;
+        int key_len = p - key;
+        if (key_len == 0 || *p != '=')
+            fnt_error(key, "expected key=value");
+        p++;
+
+        const char *val;
+        if (*p == '"') {
+            val = ++p;
+            while (*p != '"' && *p != '\n' && *p != '\0')
+                p++;
+            if (*p != '"')
+                fnt_error(val, "unterminated string");
+            add_attr(rec, key, key_len, val, p - val);
+            p++;
+        } else {
+            val = p;
+            while ((unsigned char)*p > ' ')
+                p++;
+            add_attr(rec, key, key_len, val, p - val);
+        }
     }
+}
 
-    assert(fclose(fp) == 0);
+
+// Split the XML element at p (just past its '<') into rec. Returns just
+// past its '>'.
+static const char *fnt_xml_record(const char *p, struct FntRecord *rec)
+{
+    rec->num_attrs = 0;
+
+    rec->tag = p;
+    while (fnt_word_char(*p))
+        p++;
+    rec->tag_len = p - rec->tag;
+
+    for (;;) {
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == '/')
+            p++;
+        if (*p == '>')
+            return p + 1;
+        if (*p == '\0')
+            fnt_error(rec->tag, "unterminated <%.*s>", rec->tag_len, rec->tag);
+
+        const char *key = p;
+        while (fnt_word_char(*p))
+            p++;
+        int key_len = p - key;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (key_len == 0 || *p != '=')
+            fnt_error(key, "expected key=\"value\"");
+        p++;
+        while (isspace((unsigned char)*p))
+            p++;
+
+        char quote = *p;
+        if (quote != '"' && quote != '\'')
+            fnt_error(p, "expected quoted value");
+        const char *val = ++p;
+        while (*p != quote && *p != '\0')
+            p++;
+        if (*p != quote)
+            fnt_error(val, "unterminated string");
+        add_attr(rec, key, key_len, val, p - val);
+        p++;
+    }
+}
+
+
+// page 0's file name, relative to the .fnt's directory; XML entities are
+// decoded if xml
+static void set_page(const char *file, int len, int xml)
+{
+    const char *slash = strrchr(fnt_fn, '/');
+    int dir_len = (slash == NULL || file[0] == '/') ? 0 : (slash + 1 - fnt_fn);
+
+    if (dir_len + len >= FILENAME_MAX)
+        fnt_error(file, "page file name too long");
+
+    memcpy(page_fn, fnt_fn, dir_len);
+    char *out = page_fn + dir_len;
+    for (int i = 0; i < len; i++) {
+        static const struct { const char *entity; char c; } entities[] = {
+            { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' },
+            { "&quot;", '"' }, { "&apos;", '\'' },
+        };
+        int j = 0;
+        int n = sizeof(entities) / sizeof(entities[0]);
+        if (xml && file[i] == '&') {
+            for (j = 0; j < n; j++) {
+                int e_len = strlen(entities[j].entity);
+                if (len - i >= e_len &&
+                    memcmp(file + i, entities[j].entity, e_len) == 0) {
+                    *out++ = entities[j].c;
+                    i += e_len - 1;
+                    break;
+                }
+            }
+        }
+        if (!xml || file[i] != '&' || j == n)
+            *out++ = file[i];
+    }
+    *out = '\0';
+}
+
+
+// add one character's glyph; at is where it is described, for errors
+static void add_glyph(const char *at, long c, int x, int y, int w, int h,
+                      int x_off, int y_off, int x_adv, int page)
+{
+    if (c < 0 || c >= 128) {
+        chars_skipped++;
+        return;
+    }
+
+    if (glyph_info.glyph[c].off >= 0)
+        fnt_error(at, "char %ld is described twice", c);
+    if (page != 0)
+        fnt_error(at, "char %ld is on page %d; only page 0 is supported",
+                  c, page);
+    if (x < 0 || y < 0 || w < 0 || h < 0)
+        fnt_error(at, "char %ld has a negative position or size", c);
+
+    glyph_info.glyph[c].x = x;
+    glyph_info.glyph[c].y = y;
+    glyph_info.glyph[c].w = w;
+    glyph_info.glyph[c].h = h;
+    glyph_info.glyph[c].x_off = x_off;
+    glyph_info.glyph[c].y_off = y_off;
+    glyph_info.glyph[c].x_adv = x_adv;
+
+    // where in the glyph data array this one is
+    glyph_info.glyph[c].off = gs_bytes;
+
+    // updates mins/maxs
+    if (glyph_info.x_adv_max < glyph_info.glyph[c].x_adv)
+        glyph_info.x_adv_max = glyph_info.glyph[c].x_adv;
+
+    if (glyph_info.x_off_min > glyph_info.glyph[c].x_off)
+        glyph_info.x_off_min = glyph_info.glyph[c].x_off;
+
+    // x_off_max is really the max of (x_off + w), to see how far the
+    // glyph might extend, similar for y_off_max
+    if (glyph_info.x_off_max < (glyph_info.glyph[c].x_off + glyph_info.glyph[c].w))
+        glyph_info.x_off_max = glyph_info.glyph[c].x_off + glyph_info.glyph[c].w;
+
+    if (glyph_info.y_off_min > glyph_info.glyph[c].y_off)
+        glyph_info.y_off_min = glyph_info.glyph[c].y_off;
+
+    if (glyph_info.y_off_max < (glyph_info.glyph[c].y_off + glyph_info.glyph[c].h))
+        glyph_info.y_off_max = glyph_info.glyph[c].y_off + glyph_info.glyph[c].h;
+
+    // total bytes required in the glyph data array
+    gs_bytes += (glyph_info.glyph[c].w * glyph_info.glyph[c].h);
+}
+
+
+// handle a text or XML record
+static void fnt_apply(const struct FntRecord *rec, int xml)
+{
+    static const int zero = 0;
+
+    if (fnt_is(rec->tag, rec->tag_len, "char")) {
+        int c = fnt_int(rec, "id", NULL);
+        if (c < 0 || c >= 128) {
+            chars_skipped++; // without looking at the rest
+            return;
+        }
+        add_glyph(rec->tag, c,
+                  fnt_int(rec, "x", NULL), fnt_int(rec, "y", NULL),
+                  fnt_int(rec, "width", NULL), fnt_int(rec, "height", NULL),
+                  fnt_int(rec, "xoffset", NULL), fnt_int(rec, "yoffset", NULL),
+                  fnt_int(rec, "xadvance", NULL), fnt_int(rec, "page", &zero));
+    } else if (fnt_is(rec->tag, rec->tag_len, "kerning")) {
+        kernings++;
+    } else if (fnt_is(rec->tag, rec->tag_len, "common")) {
+        glyph_info.y_adv = fnt_int(rec, "lineHeight", NULL);
+    } else if (fnt_is(rec->tag, rec->tag_len, "page")) {
+        if (fnt_int(rec, "id", NULL) == 0) {
+            int len;
+            const char *file = fnt_attr(rec, "file", &len);
+            if (file == NULL)
+                fnt_error(rec->tag, "page: no file");
+            set_page(file, len, xml);
+        }
+    }
+    // info, chars, kernings, and XML's font and pages are not needed
+}
+
+
+static int le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+
+static long le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((long)p[3] << 24);
+}
+
+
+// parse binary description: "BMF", version, then blocks of
+// (type byte, size uint32, data)
+static void fnt_parse_binary(const uint8_t *buf, long len)
+{
+    if (len < 4 || buf[3] != 3)
+        fnt_error((const char *)buf, "binary version %d not supported (only 3)",
+                  len < 4 ? -1 : buf[3]);
+
+    long pos = 4;
+    while (pos < len) {
+        const char *at = (const char *)buf + pos;
+        if (len - pos < 5)
+            fnt_error(at, "truncated block header");
+        int type = buf[pos];
+        long size = le32(buf + pos + 1);
+        pos += 5;
+        if (size > len - pos)
+            fnt_error(at, "block %d runs past end of file", type);
+        const uint8_t *b = buf + pos;
+
+        switch (type) {
+        case 1: // info
+            break;
+        case 2: // common
+            if (size < 4)
+                fnt_error(at, "common block too short");
+            glyph_info.y_adv = le16(b);
+            break;
+        case 3: // pages, '\0'-terminated file names
+            if (memchr(b, '\0', size) == NULL)
+                fnt_error(at, "bad pages block");
+            set_page((const char *)b, strlen((const char *)b), 0);
+            break;
+        case 4: // chars, 20 bytes each
+            if (size % 20 != 0)
+                fnt_error(at, "chars block size not a multiple of 20");
+            for (long i = 0; i < size; i += 20)
+                add_glyph((const char *)b + i, le32(b + i),
+                          le16(b + i + 4), le16(b + i + 6),
+                          le16(b + i + 8), le16(b + i + 10),
+                          (int16_t)le16(b + i + 12), (int16_t)le16(b + i + 14),
+                          (int16_t)le16(b + i + 16), b[i + 18]);
+            break;
+        case 5: // kerning pairs, 10 bytes each
+            kernings += size / 10;
+            break;
+        default:
+            fnt_error(at, "unknown block type %d", type);
+        }
+
+        pos += size;
+    }
+}
+
+
+// parse XML description
+static void fnt_parse_xml(const char *p)
+{
+    struct FntRecord rec;
+    while ((p = strchr(p, '<')) != NULL) {
+        p++;
+        if (*p == '?') {
+            p = strstr(p, "?>");
+        } else if (strncmp(p, "!--", 3) == 0) {
+            p = strstr(p, "-->");
+        } else if (*p == '/' || *p == '!') {
+            p = strchr(p, '>');
+        } else {
+            p = fnt_xml_record(p, &rec);
+            fnt_apply(&rec, 1);
+            continue;
+        }
+        if (p == NULL)
+            fnt_error(NULL, "unterminated markup");
+    }
+}
+
+
+// parse text description
+static void fnt_parse_text(const char *p)
+{
+    struct FntRecord rec;
+    while (*p != '\0') {
+        p = fnt_text_record(p, &rec);
+        if (rec.tag_len > 0)
+            fnt_apply(&rec, 0);
+    }
+}
+
+
+// read BMFont description file
+static void read_description(const char *fn_root)
+{
+    static char fn_buf[FILENAME_MAX];
+    fnt_fn = file_name(fn_buf, fn_root, ".fnt");
+
+    long len;
+    char *buf = read_file(fnt_fn, &len);
+    fnt_buf = buf;
+
+    memset(&glyph_info, 0, sizeof(glyph_info));
+
+    // glyph's offset = -1 means it is not present
+    for (int i = 0; i < 128; i++)
+        glyph_info.glyph[i].off = -1;
+
+    // initialize mins/maxs
+    glyph_info.x_adv_max = INT8_MIN;
+    glyph_info.x_off_min = INT8_MAX;
+    glyph_info.x_off_max = INT8_MIN;
+    glyph_info.y_off_min = INT8_MAX;
+    glyph_info.y_off_max = INT8_MIN;
+
+    gs_bytes = 0;
+    chars_skipped = 0;
+    kernings = 0;
+    glyph_info.y_adv = -1;
+
+    // page 0 is <root>_0.png unless the description says otherwise
+    file_name(page_fn, fn_root, "_0.png");
+
+    const char *p = buf;
+    if (len >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0)
+        p += 3; // UTF-8 byte order mark
+
+    fnt_binary = (len >= 3 && memcmp(buf, "BMF", 3) == 0);
+    if (fnt_binary) {
+        fnt_parse_binary((const uint8_t *)buf, len);
+    } else {
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == '<')
+            fnt_parse_xml(p);
+        else
+            fnt_parse_text(p);
+    }
+
+    if (glyph_info.y_adv < 0)
+        fnt_error(NULL, "no line height (common lineHeight)");
+    int chars = 0;
+    for (int i = 0; i < 128; i++)
+        if (glyph_info.glyph[i].off >= 0)
+            chars++;
+    if (chars == 0)
+        fnt_error(NULL, "no characters in 0..127");
+
+    free(buf);
+    fnt_buf = NULL;
 }
 
 
@@ -142,15 +665,15 @@ static void print_description()
 }
 
 
-// read png into global image[]
-static void read_png(const char *fn_root)
+// read png (page_fn, from the description) into global image[]
+static void read_png(const char *fn)
 {
-    char fn_buf[80];
-    //sprintf(fn_buf, "%s.png", fn_root); // fontbuilder
-    sprintf(fn_buf, "%s_0.png", fn_root); // bmfont
-    //printf("reading %s\n", fn_buf);
-    FILE *fp = fopen(fn_buf, "rb");
-    assert(fp != NULL);
+    //printf("reading %s\n", fn);
+    FILE *fp = fopen(fn, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", fn, strerror(errno));
+        exit(1);
+    }
 
     png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     assert(png_ptr != NULL);
@@ -162,6 +685,9 @@ static void read_png(const char *fn_root)
 
     png_read_info(png_ptr, info_ptr);
 
+    free(image); // previous font's, if any
+    image = NULL;
+
     assert(png_get_IHDR(png_ptr, info_ptr, &image_width, &image_height,
                         NULL, NULL, NULL, NULL, NULL) == 1);
 
@@ -182,7 +708,7 @@ static void read_png(const char *fn_root)
     memset(image, 0, sizeof(image));
     for (int r = 0; r < image_height; r++)
         for (int c = 0; c < image_width; c++)
-            image[r * image_width + c] = row_ptrs[r][c];
+            image[r * image_width + c] = coverage[row_ptrs[r][c]];
 
     for (int r = 0; r < image_height; r++) {
         png_free(png_ptr, row_ptrs[r]);
@@ -196,6 +722,18 @@ static void read_png(const char *fn_root)
 
     assert(fclose(fp) == 0);
 
+    // glyphs must be inside the image
+    for (int i = 0; i < 128; i++) {
+        if (glyph_info.glyph[i].off < 0)
+            continue;
+        if (glyph_info.glyph[i].x + glyph_info.glyph[i].w > image_width ||
+            glyph_info.glyph[i].y + glyph_info.glyph[i].h > image_height) {
+            fprintf(stderr, "%s: char %d is outside the %ux%u image\n",
+                    fn, i, (unsigned)image_width, (unsigned)image_height);
+            exit(1);
+        }
+    }
+
 } // read_png()
 
 
@@ -207,10 +745,13 @@ int as_int8(int v)
 }
 
 
-// write .h and .cpp files for font
-static void write_code(const char *fn_root)
+// Write .h and .cpp files for font, in the current directory. name is
+// used for the file names and in the font's identifiers. If descriptor is
+// nonzero, the .h also gets a <name>_desc struct describing the font at
+// compile time, for Ws24::print<name>_desc>().
+static void write_code(const char *name, int descriptor)
 {
-    char fn_buf[80];
+    char fn_buf[FILENAME_MAX];
     FILE *fp;
 
     // font.h defines "struct Font" and looks something like this:
@@ -242,18 +783,57 @@ static void write_code(const char *fn_root)
 
     // font's .h file
 
-    sprintf(fn_buf, "%s.h", fn_root);
-    fp = fopen(fn_buf, "w");
+    fp = fopen(file_name(fn_buf, name, ".h"), "w");
     assert(fp != NULL);
 
     fprintf(fp, "#pragma once\n");
     fprintf(fp, "\n");
     fprintf(fp, "#include \"font.h\"\n");
     fprintf(fp, "\n");
-    fprintf(fp, "const int %s_max_height = %d;\n", fn_root, glyph_info.y_adv);
-    fprintf(fp, "const int %s_max_width = %d;\n", fn_root, glyph_info.x_adv_max);
+    fprintf(fp, "const int %s_max_height = %d;\n", name, glyph_info.y_adv);
+    fprintf(fp, "const int %s_max_width = %d;\n", name, glyph_info.x_adv_max);
     fprintf(fp, "\n");
-    fprintf(fp, "extern const struct Font %s;\n", fn_root);
+    fprintf(fp, "extern const struct Font %s;\n", name);
+
+    if (descriptor) {
+        // cell_width is every glyph's x_adv if they are all the same;
+        // *_inside is whether every glyph is inside its box, so cropping
+        // is not needed
+        int cell_width = -1;
+        int rows_inside = 1;
+        int cols_inside = 1;
+        for (int i = 0; i < 128; i++) {
+            if (glyph_info.glyph[i].off < 0)
+                continue;
+            if (cell_width == -1)
+                cell_width = glyph_info.glyph[i].x_adv;
+            else if (cell_width != glyph_info.glyph[i].x_adv)
+                cell_width = 0;
+            if (glyph_info.glyph[i].w > 0 &&
+                (glyph_info.glyph[i].x_off < 0 ||
+                 glyph_info.glyph[i].x_off + glyph_info.glyph[i].w > glyph_info.glyph[i].x_adv))
+                cols_inside = 0;
+            if (glyph_info.glyph[i].h > 0 &&
+                (glyph_info.glyph[i].y_off < 0 ||
+                 glyph_info.glyph[i].y_off + glyph_info.glyph[i].h > glyph_info.y_adv))
+                rows_inside = 0;
+        }
+        if (cell_width < 0)
+            cell_width = 0;
+
+        fprintf(fp, "\n");
+        fprintf(fp, "// compile-time description, for Ws24::print<%s_desc>()\n", name);
+        fprintf(fp, "struct %s_desc {\n", name);
+        fprintf(fp, "    static const Font& font() { return %s; }\n", name);
+        fprintf(fp, "    static constexpr int height = %d; // y_adv\n", glyph_info.y_adv);
+        fprintf(fp, "    static constexpr int cell_width = %d; // every x_adv, 0 if they differ\n", cell_width);
+        fprintf(fp, "    static constexpr int bpp = 8; // glyph data bits per pixel\n");
+        fprintf(fp, "    static constexpr bool rows_inside = %s; // no glyph needs cropping top/bottom\n",
+                rows_inside ? "true" : "false");
+        fprintf(fp, "    static constexpr bool cols_inside = %s; // no glyph needs cropping left/right\n",
+                cols_inside ? "true" : "false");
+        fprintf(fp, "};\n");
+    }
 
     assert(fclose(fp) == 0);
 
@@ -261,16 +841,15 @@ static void write_code(const char *fn_root)
     //
     // This is cpp (instead of c) for the member functions in struct Font
 
-    sprintf(fn_buf, "%s.cpp", fn_root);
-    fp = fopen(fn_buf, "w");
+    fp = fopen(file_name(fn_buf, name, ".cpp"), "w");
     assert(fp != NULL);
 
     fprintf(fp, "#include <stdint.h>\n");
-    fprintf(fp, "#include \"%s.h\"\n", fn_root);
+    fprintf(fp, "#include \"%s.h\"\n", name);
     fprintf(fp, "\n");
-    fprintf(fp, "extern const uint8_t %s_data[];\n", fn_root);
+    fprintf(fp, "extern const uint8_t %s_data[];\n", name);
     fprintf(fp, "\n");
-    fprintf(fp, "const Font %s = {\n", fn_root);
+    fprintf(fp, "const Font %s = {\n", name);
     fprintf(fp, "    %d, // int8_t y_adv\n", as_int8(glyph_info.y_adv));
     fprintf(fp, "    %d, // int8_t x_adv_max\n", as_int8(glyph_info.x_adv_max));
     fprintf(fp, "    %d, // int8_t x_off_min\n", as_int8(glyph_info.x_off_min));
@@ -290,10 +869,12 @@ static void write_code(const char *fn_root)
         fprintf(fp, "\n");
     }
     fprintf(fp, "    },\n");
-    fprintf(fp, "    %s_data // const uint8_t *data\n", fn_root);
+    fprintf(fp, "    %s_data // const uint8_t *data\n", name);
     fprintf(fp, "};\n");
     fprintf(fp, "\n");
-    fprintf(fp, "const uint8_t %s_data[%d] = {\n", fn_root, gs_bytes);
+    if (coverage_note[0] != '\0')
+        fprintf(fp, "// coverage curve: %s\n", coverage_note);
+    fprintf(fp, "const uint8_t %s_data[%d] = {\n", name, gs_bytes);
     for (int i = 0; i < 128; i++) {
         if (glyph_info.glyph[i].off < 0)
             continue;
@@ -321,20 +902,872 @@ static void write_code(const char *fn_root)
 } // write_code()
 
 
-int main(int argc, char *argv[])
+// bytes for a run-length encoded glyph: (count, gray) byte pairs
+static int rle_bytes(const uint8_t *img, int stride, int w, int h)
 {
-    if (argc != 2) {
-        printf("usage: %s <filename_root>\n", argv[0]);
+    int bytes = 0;
+    int run = 0;
+    int prev = -1;
+    for (int r = 0; r < h; r++) {
+        for (int c = 0; c < w; c++) {
+            int v = img[r * stride + c];
+            if (v == prev && run < 255) {
+                run++;
+                continue;
+            }
+            if (run > 0)
+                bytes += 2;
+            prev = v;
+            run = 1;
+        }
+    }
+    if (run > 0)
+        bytes += 2;
+    return bytes;
+}
+
+
+static int fits_int8(int v)
+{
+    return v >= INT8_MIN && v <= INT8_MAX;
+}
+
+
+// Write size and cost report for the font as json, to stdout if report_fn
+// is "-". Sizes assume a 32-bit target (e.g. rp2040):
+//   metadata: struct Font, 12 bytes per info[] entry plus 12 bytes
+//   gray8: what make_font writes, one byte per glyph pixel
+//   gray4, gray2, gray1, rle: estimates for other storage formats
+//   work_bytes: smallest Ws24 work buffer that can draw the glyph
+//   spi_bytes: bytes sent per draw (3 commands, 8 bytes of window
+//     parameters, 2 bytes per pixel of the glyph's box)
+// Metrics that do not fit the int8_t fields in struct Font are listed in
+// "overflow" instead of failing. Returns the number of overflows.
+static int write_report(const char *fn_root, const char *report_fn)
+{
+    FILE *fp = stdout;
+    if (strcmp(report_fn, "-") != 0) {
+        fp = fopen(report_fn, "w");
+        assert(fp != NULL);
+    }
+
+    const int info_bytes = 12;
+    const int metadata_bytes = 8 + 128 * info_bytes + 4;
+
+    int gray8 = 0, gray4 = 0, gray2 = 0, gray1 = 0, rle = 0;
+    int work_bytes = 128; // Ws24::init_colors() needs this much
+    int spi_bytes_max = 0;
+    int overflows = 0;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"font\": \"%s\",\n", fn_root);
+    fprintf(fp, "  \"glyphs\": [\n");
+
+    int first = 1;
+    for (int i = 0; i < 128; i++) {
+        if (glyph_info.glyph[i].off < 0)
+            continue;
+
+        const int w = glyph_info.glyph[i].w;
+        const int h = glyph_info.glyph[i].h;
+        const int x_adv = glyph_info.glyph[i].x_adv;
+        const int pixels = w * h;
+        const int g_rle = rle_bytes(&image[glyph_info.glyph[i].y * image_width +
+                                           glyph_info.glyph[i].x],
+                                    image_width, w, h);
+        const int g_work = glyph_info.y_adv * x_adv * 2;
+        const int g_spi = 3 + 8 + glyph_info.y_adv * x_adv * 2;
+
+        gray8 += pixels;
+        gray4 += (pixels + 1) / 2;
+        gray2 += (pixels + 3) / 4;
+        gray1 += (pixels + 7) / 8;
+        rle += g_rle;
+        if (work_bytes < g_work)
+            work_bytes = g_work;
+        if (spi_bytes_max < g_spi)
+            spi_bytes_max = g_spi;
+
+        fprintf(fp, "%s    { \"char\": %d, ", first ? "" : ",\n", i);
+        first = 0;
+        fprintf(fp, "\"w\": %d, \"h\": %d, \"x_off\": %d, \"y_off\": %d, \"x_adv\": %d, ",
+                w, h, glyph_info.glyph[i].x_off, glyph_info.glyph[i].y_off, x_adv);
+        fprintf(fp, "\"metadata\": %d, ", info_bytes);
+        fprintf(fp, "\"gray8\": %d, \"gray4\": %d, \"gray2\": %d, \"gray1\": %d, \"rle\": %d, ",
+                pixels, (pixels + 1) / 2, (pixels + 3) / 4, (pixels + 7) / 8, g_rle);
+        fprintf(fp, "\"work_bytes\": %d, \"spi_bytes\": %d, ", g_work, g_spi);
+
+        const char *names[] = { "w", "h", "x_off", "y_off", "x_adv" };
+        const int values[] = { w, h, glyph_info.glyph[i].x_off,
+                               glyph_info.glyph[i].y_off, x_adv };
+        fprintf(fp, "\"overflow\": [");
+        int n = 0;
+        for (int k = 0; k < 5; k++) {
+            if (fits_int8(values[k]))
+                continue;
+            fprintf(fp, "%s\"%s\"", n++ ? ", " : "", names[k]);
+        }
+        fprintf(fp, "] }");
+        overflows += n;
+    }
+    fprintf(fp, "\n  ],\n");
+
+    const char *names[] = { "y_adv", "x_adv_max", "x_off_min",
+                            "x_off_max", "y_off_min", "y_off_max" };
+    const int values[] = { glyph_info.y_adv, glyph_info.x_adv_max,
+                           glyph_info.x_off_min, glyph_info.x_off_max,
+                           glyph_info.y_off_min, glyph_info.y_off_max };
+    fprintf(fp, "  \"overflow\": [");
+    int n = 0;
+    for (int k = 0; k < 6; k++) {
+        if (fits_int8(values[k]))
+            continue;
+        fprintf(fp, "%s\"%s\"", n++ ? ", " : "", names[k]);
+    }
+    fprintf(fp, "],\n");
+    overflows += n;
+
+    fprintf(fp, "  \"metadata\": %d,\n", metadata_bytes);
+    fprintf(fp, "  \"gray8\": %d,\n", gray8);
+    fprintf(fp, "  \"gray4\": %d,\n", gray4);
+    fprintf(fp, "  \"gray2\": %d,\n", gray2);
+    fprintf(fp, "  \"gray1\": %d,\n", gray1);
+    fprintf(fp, "  \"rle\": %d,\n", rle);
+    fprintf(fp, "  \"work_bytes\": %d,\n", work_bytes);
+    fprintf(fp, "  \"spi_bytes_max\": %d\n", spi_bytes_max);
+    fprintf(fp, "}\n");
+
+    if (fp != stdout)
+        assert(fclose(fp) == 0);
+
+    return overflows;
+
+} // write_report()
+
+
+// Pack r, g, b into a pixel the same way Ws24's Pixel does, i.e. as the
+// uint16_t that is sent to the display low byte first.
+static uint16_t pixel_pack(int r, int g, int b)
+{
+    return ((g << 11) & 0xe000) | ((b << 5) & 0x1f00) |
+           (r & 0x00f8) | ((g >> 5) & 0x0007);
+}
+
+
+// Unpack a pixel, same as Pixel::rgb()
+static void pixel_rgb(uint16_t pixel, int *r, int *g, int *b)
+{
+    *r = pixel & 0x00f8;
+    *g = ((pixel & 0x0007) << 5) | ((pixel & 0xe000) >> 11);
+    *b = (pixel & 0x1f00) >> 5;
+}
+
+
+// Render string with the currently loaded font, exactly as Ws24::print()
+// would: each character is a y_adv by x_adv box of background, with the
+// glyph blended into it and cropped to the box. pix[] is y_adv rows of
+// width pixels, where width is the sum of the x_adv of the characters.
+static void render_label(const char *str, uint16_t fg, uint16_t bg,
+                         uint16_t *pix, int width)
+{
+    int fg_r, fg_g, fg_b;
+    pixel_rgb(fg, &fg_r, &fg_g, &fg_b);
+    int bg_r, bg_g, bg_b;
+    pixel_rgb(bg, &bg_r, &bg_g, &bg_b);
+
+    const int d_r = fg_r - bg_r;
+    const int d_g = fg_g - bg_g;
+    const int d_b = fg_b - bg_b;
+
+    for (int i = 0; i < glyph_info.y_adv * width; i++)
+        pix[i] = bg;
+
+    int left = 0; // of current character box
+    for (const char *s = str; *s != '\0'; s++) {
+        int c = *s;
+        if (c < 0 || c >= 128 || glyph_info.glyph[c].off < 0)
+            continue;
+        const int x_adv = glyph_info.glyph[c].x_adv;
+        for (int g_row = 0; g_row < glyph_info.glyph[c].h; g_row++) {
+            for (int g_col = 0; g_col < glyph_info.glyph[c].w; g_col++) {
+                int p_row = g_row + glyph_info.glyph[c].y_off;
+                int p_col = g_col + glyph_info.glyph[c].x_off;
+                if (p_row < 0 || p_row >= glyph_info.y_adv)
+                    continue;
+                if (p_col < 0 || p_col >= x_adv)
+                    continue;
+                int r = glyph_info.glyph[c].y + g_row;
+                int cc = glyph_info.glyph[c].x + g_col;
+                int gray = image[r * image_width + cc];
+                pix[p_row * width + left + p_col] =
+                    pixel_pack(bg_r + d_r * gray / 255,
+                               bg_g + d_g * gray / 255,
+                               bg_b + d_b * gray / 255);
+            }
+        }
+        left += x_adv;
+    }
+}
+
+
+// Compress pixels, returning number of uint16_t written to out[] (which
+// must be at least 2 * num_pix long). Each chunk starts with a count word:
+//   0x8000 | n:  next word is one pixel, repeated n times
+//   n:           next n words are pixels
+static int compress_label(const uint16_t *pix, int num_pix, uint16_t *out)
+{
+    int out_len = 0;
+    int i = 0;
+    while (i < num_pix) {
+        // length of run starting at i
+        int run = 1;
+        while (i + run < num_pix && run < 0x7fff && pix[i + run] == pix[i])
+            run++;
+        if (run >= 3) {
+            out[out_len++] = 0x8000 | run;
+            out[out_len++] = pix[i];
+            i += run;
+            continue;
+        }
+        // literals until the next run of 3 or more
+        int lit = 0;
+        while (i + lit < num_pix && lit < 0x7fff) {
+            if (i + lit + 2 < num_pix && pix[i + lit] == pix[i + lit + 1] &&
+                pix[i + lit] == pix[i + lit + 2])
+                break;
+            lit++;
+        }
+        out[out_len++] = lit;
+        memcpy(&out[out_len], &pix[i], lit * sizeof(uint16_t));
+        out_len += lit;
+        i += lit;
+    }
+    return out_len;
+}
+
+
+// Label output is written to <file>.tmp and renamed when complete; if
+// make_font exits before then, these are removed so a half-written .h or
+// .cpp is never left where a build would find it.
+static char labels_tmp[2][FILENAME_MAX];
+
+static void remove_labels_tmp(void)
+{
+    for (int i = 0; i < 2; i++) {
+        if (labels_tmp[i][0] != '\0') {
+            remove(labels_tmp[i]);
+            labels_tmp[i][0] = '\0';
+        }
+    }
+}
+
+
+// open fn.tmp for writing, remembering it in labels_tmp[i]
+static FILE *open_labels_tmp(int i, const char *fn)
+{
+    file_name(labels_tmp[i], fn, ".tmp");
+    FILE *fp = fopen(labels_tmp[i], "w");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", labels_tmp[i], strerror(errno));
         exit(1);
     }
+    return fp;
+}
 
-    read_description(argv[1]);
 
-    //print_description();
+// close fn.tmp and rename it to fn
+static void commit_labels_tmp(int i, FILE *fp, const char *fn)
+{
+    if (fclose(fp) != 0 || rename(labels_tmp[i], fn) != 0) {
+        fprintf(stderr, "%s: %s\n", fn, strerror(errno));
+        exit(1);
+    }
+    labels_tmp[i][0] = '\0';
+}
 
-    read_png(argv[1]);
 
-    write_code(argv[1]);
+// nonzero if s is a C identifier
+static int is_identifier(const char *s)
+{
+    if (!isalpha((unsigned char)*s) && *s != '_')
+        return 0;
+    for (s++; *s != '\0'; s++)
+        if (!isalnum((unsigned char)*s) && *s != '_')
+            return 0;
+    return 1;
+}
+
 
+// Number of bytes in the UTF-8 character at s, with its code point in
+// *code. A byte that does not start a valid sequence counts as one
+// character, with *code -1.
+static int utf8_char(const char *s, long *code)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    int n;
+    long c;
+    if (u[0] < 0x80) {
+        *code = u[0];
+        return 1;
+    } else if ((u[0] & 0xe0) == 0xc0 && u[0] >= 0xc2) {
+        n = 2;
+        c = u[0] & 0x1f;
+    } else if ((u[0] & 0xf0) == 0xe0) {
+        n = 3;
+        c = u[0] & 0x0f;
+    } else if ((u[0] & 0xf8) == 0xf0 && u[0] <= 0xf4) {
+        n = 4;
+        c = u[0] & 0x07;
+    } else {
+        *code = -1;
+        return 1;
+    }
+    for (int i = 1; i < n; i++) {
+        if ((u[i] & 0xc0) != 0x80) {
+            *code = -1;
+            return 1;
+        }
+        c = (c << 6) | (u[i] & 0x3f);
+    }
+    // overlong, surrogate, or past U+10FFFF
+    static const long min_code[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (c < min_code[n] || (c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff) {
+        *code = -1;
+        return 1;
+    }
+    *code = c;
+    return n;
+}
+
+
+// nonzero if the character at s (n bytes) also appears in str before s
+static int seen_before(const char *str, const char *s, int n)
+{
+    for (const char *t = str; t < s; ) {
+        long code;
+        int m = utf8_char(t, &code);
+        if (m == n && memcmp(t, s, n) == 0)
+            return 1;
+        t += m;
+    }
     return 0;
 }
+
+
+// Write .h and .cpp files with pre-rendered label sprites.
+//
+// Each line of the labels file is:
+//   <name> <font_root> <fg> <bg> <text...>
+// where fg and bg are rrggbb hex, and text is the rest of the line. Blank
+// lines and lines starting with '#' are ignored. If compress is nonzero,
+// labels are run-length encoded when that makes them smaller.
+static void write_labels(const char *labels_fn, int compress)
+{
+    FILE *in = fopen(labels_fn, "r");
+    assert(in != NULL);
+
+    // output files are named after the labels file, minus extension
+    char fn_root[FILENAME_MAX];
+    file_name(fn_root, labels_fn, "");
+    char *dot = strrchr(fn_root, '.');
+    if (dot != NULL && strchr(dot, '/') == NULL)
+        *dot = '\0';
+    const char *base = strrchr(fn_root, '/');
+    base = (base == NULL) ? fn_root : base + 1;
+
+    char fn_h[FILENAME_MAX];
+    char fn_c[FILENAME_MAX];
+    file_name(fn_h, fn_root, ".h");
+    file_name(fn_c, fn_root, ".cpp");
+
+    atexit(remove_labels_tmp);
+    FILE *fp_h = open_labels_tmp(0, fn_h);
+    FILE *fp_c = open_labels_tmp(1, fn_c);
+
+    fprintf(fp_h, "#pragma once\n");
+    fprintf(fp_h, "\n");
+    fprintf(fp_h, "#include \"sprite.h\"\n");
+    fprintf(fp_h, "\n");
+
+    fprintf(fp_c, "#include <stdint.h>\n");
+    fprintf(fp_c, "#include \"%s.h\"\n", base);
+
+    char font_root[80] = ""; // font currently loaded
+    char line[400];
+    int line_num = 0;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        line_num++;
+
+        int len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+
+        char *p = line;
+        while (isspace(*p))
+            p++;
+        if (*p == '\0' || *p == '#')
+            continue;
+
+        char name[64];
+        char font[80];
+        unsigned fg_rgb, bg_rgb;
+        int text_pos;
+        if (sscanf(p, "%63s %79s %x %x %n",
+                   name, font, &fg_rgb, &bg_rgb, &text_pos) != 4) {
+            fprintf(stderr, "%s:%d: expected <name> <font> <fg> <bg> <text>\n",
+                    labels_fn, line_num);
+            exit(1);
+        }
+        const char *text = p + text_pos;
+
+        if (!is_identifier(name)) {
+            fprintf(stderr, "%s:%d: label name \"%s\" is not a C identifier\n",
+                    labels_fn, line_num, name);
+            exit(1);
+        }
+
+        if (strcmp(font, font_root) != 0) {
+            read_description(font);
+            read_png(page_fn);
+            strcpy(font_root, font);
+        }
+
+        uint16_t fg = pixel_pack((fg_rgb >> 16) & 0xff, (fg_rgb >> 8) & 0xff,
+                                 fg_rgb & 0xff);
+        uint16_t bg = pixel_pack((bg_rgb >> 16) & 0xff, (bg_rgb >> 8) & 0xff,
+                                 bg_rgb & 0xff);
+
+        int width = 0;
+        for (const char *s = text; *s != '\0'; ) {
+            long c;
+            int n = utf8_char(s, &c);
+            if (c >= 0 && c < 128 && glyph_info.glyph[c].off >= 0)
+                width += glyph_info.glyph[c].x_adv;
+            else if (seen_before(text, s, n))
+                ; // already reported
+            else if (c < 0)
+                fprintf(stderr, "%s:%d: byte \\x%02x is not UTF-8, skipped\n",
+                        labels_fn, line_num, (unsigned char)*s);
+            else if (c >= 0x20 && c != 0x7f)
+                fprintf(stderr, "%s:%d: '%.*s' (U+%04lX) not in %s, skipped\n",
+                        labels_fn, line_num, n, s, c, font);
+            else
+                fprintf(stderr, "%s:%d: U+%04lX not in %s, skipped\n",
+                        labels_fn, line_num, c, font);
+            s += n;
+        }
+        if (width == 0) {
+            fprintf(stderr, "%s:%d: label %s has no characters in %s\n",
+                    labels_fn, line_num, name, font);
+            exit(1);
+        }
+        const int height = glyph_info.y_adv;
+        const int num_pix = height * width;
+
+        uint16_t *pix = malloc((num_pix + 1) * sizeof(uint16_t));
+        assert(pix != NULL);
+        render_label(text, fg, bg, pix, width);
+
+        const uint16_t *data = pix;
+        int data_len = num_pix;
+        int rle = 0;
+        uint16_t *packed = NULL;
+        if (compress) {
+            packed = malloc((2 * num_pix + 1) * sizeof(uint16_t));
+            assert(packed != NULL);
+            int packed_len = compress_label(pix, num_pix, packed);
+            if (packed_len < num_pix) {
+                data = packed;
+                data_len = packed_len;
+                rle = 1;
+            }
+        }
+
+        fprintf(fp_h, "extern const struct Sprite %s; // \"%s\"\n", name, text);
+
+        fprintf(fp_c, "\n");
+        fprintf(fp_c, "// \"%s\" %s fg=%06x bg=%06x\n", text, font, fg_rgb, bg_rgb);
+        fprintf(fp_c, "static const uint16_t %s_data[%d] = {", name, data_len);
+        for (int i = 0; i < data_len; i++) {
+            if ((i % 12) == 0)
+                fprintf(fp_c, "\n   ");
+            fprintf(fp_c, " 0x%04x,", data[i]);
+        }
+        fprintf(fp_c, "\n};\n");
+        fprintf(fp_c, "\n");
+        fprintf(fp_c, "const Sprite %s = {\n", name);
+        fprintf(fp_c, "    %d, // int16_t height\n", height);
+        fprintf(fp_c, "    %d, // int16_t width\n", width);
+        fprintf(fp_c, "    %s, // bool rle\n", rle ? "true" : "false");
+        fprintf(fp_c, "    %d, // int32_t len\n", data_len);
+        fprintf(fp_c, "    %s_data // const uint16_t *data\n", name);
+        fprintf(fp_c, "};\n");
+
+        free(packed);
+        free(pix);
+    }
+
+    commit_labels_tmp(1, fp_c, fn_c);
+    commit_labels_tmp(0, fp_h, fn_h);
+    assert(fclose(in) == 0);
+
+} // write_labels()
+
+
+// Render every glyph the way Ws24::print() would, black on white, into
+// an rgb image 16 characters wide and 8 high (a cell per character code,
+// x_adv_max by y_adv, missing characters left white). Returns the image,
+// which the caller frees.
+static uint8_t *render_specimen(int *height, int *width)
+{
+    const int cell_h = glyph_info.y_adv;
+    const int cell_w = glyph_info.x_adv_max;
+    *height = 8 * cell_h;
+    *width = 16 * cell_w;
+
+    uint8_t *rgb = malloc(*height * *width * 3);
+    assert(rgb != NULL);
+    memset(rgb, 0xff, *height * *width * 3);
+
+    uint16_t *pix = malloc((cell_h * cell_w + 1) * sizeof(uint16_t));
+    assert(pix != NULL);
+
+    const uint16_t black = pixel_pack(0, 0, 0);
+    const uint16_t white = pixel_pack(255, 255, 255);
+
+    for (int c = 1; c < 128; c++) {
+        if (glyph_info.glyph[c].off < 0)
+            continue;
+        const int x_adv = glyph_info.glyph[c].x_adv;
+        char str[2] = { (char)c, '\0' };
+        render_label(str, black, white, pix, x_adv);
+        int top = (c / 16) * cell_h;
+        int left = (c % 16) * cell_w;
+        for (int r = 0; r < cell_h; r++) {
+            for (int col = 0; col < x_adv; col++) {
+                int red, grn, blu;
+                pixel_rgb(pix[r * x_adv + col], &red, &grn, &blu);
+                uint8_t *p = &rgb[((top + r) * *width + left + col) * 3];
+                p[0] = red;
+                p[1] = grn;
+                p[2] = blu;
+            }
+        }
+    }
+
+    free(pix);
+    return rgb;
+}
+
+
+// write rgb image to png file
+static void write_rgb_png(const char *fn, const uint8_t *rgb,
+                          int height, int width)
+{
+    FILE *fp = fopen(fn, "wb");
+    assert(fp != NULL);
+
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    assert(png_ptr != NULL);
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    assert(info_ptr != NULL);
+
+    png_init_io(png_ptr, fp);
+
+    png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+
+    png_write_info(png_ptr, info_ptr);
+
+    for (int r = 0; r < height; r++)
+        png_write_row(png_ptr, (png_const_bytep)&rgb[r * width * 3]);
+
+    png_write_end(png_ptr, info_ptr);
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+    assert(fclose(fp) == 0);
+}
+
+
+// read png file as 8-bit rgb; returns image, which the caller frees
+static uint8_t *read_rgb_png(const char *fn, int *height, int *width)
+{
+    FILE *fp = fopen(fn, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: can't open\n", fn);
+        exit(1);
+    }
+
+    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    assert(png_ptr != NULL);
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    assert(info_ptr != NULL);
+
+    png_init_io(png_ptr, fp);
+
+    png_read_info(png_ptr, info_ptr);
+
+    // whatever it is, make it 8-bit rgb
+    png_set_expand(png_ptr);
+    png_set_strip_16(png_ptr);
+    png_set_strip_alpha(png_ptr);
+    png_set_gray_to_rgb(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    *height = png_get_image_height(png_ptr, info_ptr);
+    *width = png_get_image_width(png_ptr, info_ptr);
+    assert(png_get_rowbytes(png_ptr, info_ptr) == *width * 3);
+
+    uint8_t *rgb = malloc(*height * *width * 3);
+    assert(rgb != NULL);
+
+    for (int r = 0; r < *height; r++)
+        png_read_row(png_ptr, &rgb[r * *width * 3], NULL);
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+    assert(fclose(fp) == 0);
+
+    return rgb;
+}
+
+
+// Compare rendered specimen with expected image. Returns number of pixels
+// where any channel differs by more than tolerance.
+static int compare_specimen(const uint8_t *rgb, int height, int width,
+                            const char *expected_fn, int tolerance)
+{
+    int exp_height, exp_width;
+    uint8_t *exp = read_rgb_png(expected_fn, &exp_height, &exp_width);
+
+    if (exp_height != height || exp_width != width) {
+        fprintf(stderr, "%s: is %dx%d, rendered %dx%d\n",
+                expected_fn, exp_width, exp_height, width, height);
+        free(exp);
+        return height * width;
+    }
+
+    int bad = 0;
+    int max_diff = 0;
+    for (int r = 0; r < height; r++) {
+        for (int c = 0; c < width; c++) {
+            int diff = 0;
+            for (int k = 0; k < 3; k++) {
+                int i = (r * width + c) * 3 + k;
+                int d = abs((int)rgb[i] - (int)exp[i]);
+                if (diff < d)
+                    diff = d;
+            }
+            if (max_diff < diff)
+                max_diff = diff;
+            if (diff <= tolerance)
+                continue;
+            if (bad < 10) {
+                // which character's cell this is in
+                int ch = (r / glyph_info.y_adv) * 16 + c / glyph_info.x_adv_max;
+                fprintf(stderr, "%s: row %d col %d (char %d) differs by %d\n",
+                        expected_fn, r, c, ch, diff);
+            }
+            bad++;
+        }
+    }
+
+    fprintf(stderr, "%s: %d pixels differ by more than %d, max difference %d\n",
+            expected_fn, bad, tolerance, max_diff);
+
+    free(exp);
+    return bad;
+}
+
+
+// milliseconds since previous call
+static double lap_ms()
+{
+    static struct timespec prev;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double ms = (now.tv_sec - prev.tv_sec) * 1e3 + (now.tv_nsec - prev.tv_nsec) / 1e6;
+    prev = now;
+    return ms;
+}
+
+
+static void usage(const char *prog)
+{
+    printf("usage: %s [options] <filename_root>\n", prog);
+    printf("       %s -l <labels_file> [-z] [curve options]\n", prog);
+    printf("options:\n");
+    printf("  -n <name>  name of output files and font (default: filename_root\n");
+    printf("             without directory)\n");
+    printf("  -p <png>   read glyphs from png instead of the page named in\n");
+    printf("             the .fnt\n");
+    printf("  -s <png>   also write all glyphs rendered as on the display\n");
+    printf("  -e <png>   compare glyphs rendered as on the display with png,\n");
+    printf("             exit status 2 if different\n");
+    printf("  -t <n>     per-channel tolerance for -e (default 0)\n");
+    printf("  -T         print time taken by each step\n");
+    printf("  -d         also write compile-time descriptor <name>_desc\n");
+    printf("  -r <json>  write size/cost report (\"-\" for stdout) instead of code\n");
+    printf("curve options, applied to glyph coverage:\n");
+    printf("  -g <g>     gamma, 2.2 for linear-light blending (default 1)\n");
+    printf("  -i         gamma curve is for dark text on a light background\n");
+    printf("  -c <k>     contrast, > 1 sharpens edges (default 1)\n");
+    printf("  -w <d>     stem darkening, boosts partial coverage by 1 + d\n");
+    printf("             (default 0)\n");
+    exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *labels_fn = NULL;
+    int compress = 0;
+    const char *specimen_fn = NULL;
+    const char *expected_fn = NULL;
+    int tolerance = 0;
+    int timing = 0;
+    const char *report_fn = NULL;
+    const char *name = NULL;
+    int descriptor = 0;
+    const char *png_fn = NULL;
+    double gamma = 1.0;
+    double contrast = 1.0;
+    double darken = 0.0;
+    int inverted = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:zs:e:t:Tr:n:dg:ic:w:p:")) != -1) {
+        switch (opt) {
+        case 'p':
+            png_fn = optarg;
+            break;
+        case 'g':
+            gamma = atof(optarg);
+            if (gamma <= 0.0)
+                usage(argv[0]);
+            break;
+        case 'i':
+            inverted = 1;
+            break;
+        case 'c':
+            contrast = atof(optarg);
+            if (contrast <= 0.0)
+                usage(argv[0]);
+            break;
+        case 'w':
+            darken = atof(optarg);
+            if (darken < 0.0)
+                usage(argv[0]);
+            break;
+        case 'd':
+            descriptor = 1;
+            break;
+        case 'n':
+            name = optarg;
+            break;
+        case 'r':
+            report_fn = optarg;
+            break;
+        case 's':
+            specimen_fn = optarg;
+            break;
+        case 'e':
+            expected_fn = optarg;
+            break;
+        case 't':
+            tolerance = atoi(optarg);
+            break;
+        case 'T':
+            timing = 1;
+            break;
+        case 'l':
+            labels_fn = optarg;
+            break;
+        case 'z':
+            compress = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    make_coverage(gamma, contrast, darken, inverted);
+
+    if (labels_fn != NULL) {
+        if (optind != argc)
+            usage(argv[0]);
+        write_labels(labels_fn, compress);
+        return 0;
+    }
+
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    const char *fn_root = argv[optind];
+
+    if (name == NULL) {
+        name = strrchr(fn_root, '/');
+        name = (name == NULL) ? fn_root : name + 1;
+    }
+
+    lap_ms();
+
+    read_description(fn_root);
+    if (timing)
+        fprintf(stderr, "read_description: %.3f ms (%d skipped chars, %d kernings)\n",
+                lap_ms(), chars_skipped, kernings);
+
+    //print_description();
+
+    if (png_fn != NULL)
+        file_name(page_fn, png_fn, "");
+
+    read_png(page_fn);
+    if (timing)
+        fprintf(stderr, "read_png: %.3f ms\n", lap_ms());
+
+    if (report_fn != NULL) {
+        int overflows = write_report(name, report_fn);
+        if (timing)
+            fprintf(stderr, "write_report: %.3f ms\n", lap_ms());
+        if (overflows > 0) {
+            fprintf(stderr, "%s: %d metrics do not fit in int8_t\n",
+                    name, overflows);
+            return 2;
+        }
+        return 0;
+    }
+
+    write_code(name, descriptor);
+    if (timing)
+        fprintf(stderr, "write_code: %.3f ms\n", lap_ms());
+
+    if (specimen_fn == NULL && expected_fn == NULL)
+        return 0;
+
+    int height, width;
+    uint8_t *rgb = render_specimen(&height, &width);
+    if (timing)
+        fprintf(stderr, "render_specimen: %.3f ms\n", lap_ms());
+
+    if (specimen_fn != NULL) {
+        write_rgb_png(specimen_fn, rgb, height, width);
+        if (timing)
+            fprintf(stderr, "write_rgb_png: %.3f ms\n", lap_ms());
+    }
+
+    int bad = 0;
+    if (expected_fn != NULL) {
+        bad = compare_specimen(rgb, height, width, expected_fn, tolerance);
+        if (timing)
+            fprintf(stderr, "compare_specimen: %.3f ms\n", lap_ms());
+    }
+
+    free(rgb);
+
+    return (bad == 0) ? 0 : 2;
+}
@@ -0,0 +1,128 @@
+# add_smooth_font(<name> FNT <file.fnt> [PNG <file.png>] [OPTIONS <opt>...])
+#
+# Generate <name>.h and <name>.cpp from BMFont output with make_font at
+# build time, and make a static library target <name> from them. Link
+# the library and include "<name>.h" to use the font.
+#
+# FNT is the BMFont description file (text, XML, or binary). PNG defaults
+# to the page 0 png the .fnt names, relative to it, or <root>_0.png if it
+# names none; the .fnt is read when CMake configures, and again whenever
+# it changes. Whichever png is used is what make_font reads (-p) and what
+# the font depends on. OPTIONS are passed to make_font.
+#
+# make_font only runs when a hash of its inputs (fnt, png, options, and
+# the make_font executable itself) changes, and the .h and .cpp are only
+# replaced if their contents change. So touching a font's files without
+# changing them, or changing one font, only rebuilds what is different.
+# Each font is a separate build step, so fonts are generated in parallel.
+#
+# BMFont runs on Windows, so going from a TrueType font to .fnt/.png is
+# still a separate step; see the top-level README.
+
+set(SMOOTH_FONT_GEN ${CMAKE_CURRENT_LIST_DIR}/smooth_font_gen.cmake
+    CACHE INTERNAL "")
+set(SMOOTH_FONT_INCLUDE ${CMAKE_CURRENT_LIST_DIR}/../arduino/libraries/fonts
+    CACHE INTERNAL "")
+
+# Set out to the page 0 file name in BMFont description fnt, or to "" if
+# there is none. Text and XML are searched for a page element with id 0
+# (XML entities in the name are not decoded); binary (version 3) is walked
+# block by block to the pages block.
+function(_smooth_font_page fnt out)
+    set(page "")
+
+    file(READ ${fnt} magic LIMIT 4 HEX)
+    if(magic STREQUAL "424d4603")
+        file(READ ${fnt} hex HEX)
+        string(LENGTH "${hex}" hex_len)
+        set(pos 8)
+        while(pos LESS hex_len)
+            string(SUBSTRING "${hex}" ${pos} 10 header)
+            string(SUBSTRING "${header}" 0 2 type)
+            string(SUBSTRING "${header}" 8 2 b3)
+            string(SUBSTRING "${header}" 6 2 b2)
+            string(SUBSTRING "${header}" 4 2 b1)
+            string(SUBSTRING "${header}" 2 2 b0)
+            math(EXPR size "0x${b3}${b2}${b1}${b0}")
+            math(EXPR pos "${pos} + 10")
+            if(type STREQUAL "03")
+                # first '\0'-terminated name
+                math(EXPR end "${pos} + 2 * ${size}")
+                while(pos LESS end)
+                    string(SUBSTRING "${hex}" ${pos} 2 byte)
+                    if(byte STREQUAL "00")
+                        break()
+                    endif()
+                    math(EXPR code "0x${byte}")
+                    string(ASCII ${code} ch)
+                    string(APPEND page "${ch}")
+                    math(EXPR pos "${pos} + 2")
+                endwhile()
+                break()
+            endif()
+            math(EXPR pos "${pos} + 2 * ${size}")
+        endwhile()
+    else()
+        file(STRINGS ${fnt} lines REGEX "^[ \t<]*page[ \t]")
+        foreach(line IN LISTS lines)
+            if(line MATCHES "[ \t]id=[\"']?0[\"']?([ \t/>]|$)" AND
+               line MATCHES "[ \t]file=[\"']([^\"']*)[\"']")
+                set(page "${CMAKE_MATCH_1}")
+                break()
+            endif()
+        endforeach()
+    endif()
+
+    set(${out} "${page}" PARENT_SCOPE)
+endfunction()
+
+
+function(add_smooth_font name)
+    cmake_parse_arguments(FONT "" "FNT;PNG" "OPTIONS" ${ARGN})
+
+    if(NOT FONT_FNT)
+        message(FATAL_ERROR "add_smooth_font(${name}): FNT is required")
+    endif()
+    get_filename_component(fnt ${FONT_FNT} ABSOLUTE)
+
+    # make_font reads <root>.fnt, and the png is passed with -p
+    string(REGEX REPLACE "\\.fnt$" "" root ${fnt})
+    if(FONT_PNG)
+        get_filename_component(png ${FONT_PNG} ABSOLUTE)
+    else()
+        # configure again if the .fnt (and so maybe its page) changes
+        set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${fnt})
+        _smooth_font_page(${fnt} page)
+        if(page STREQUAL "")
+            set(png ${root}_0.png)
+        else()
+            get_filename_component(fnt_dir ${fnt} DIRECTORY)
+            get_filename_component(png ${page} ABSOLUTE BASE_DIR ${fnt_dir})
+        endif()
+    endif()
+
+    set(out_dir ${CMAKE_CURRENT_BINARY_DIR}/smooth_fonts)
+    set(stamp ${out_dir}/${name}.stamp)
+
+    add_custom_command(
+        OUTPUT ${stamp}
+        BYPRODUCTS ${out_dir}/${name}.h ${out_dir}/${name}.cpp
+        COMMAND ${CMAKE_COMMAND}
+            -DTOOL=$<TARGET_FILE:make_font>
+            -DROOT=${root}
+            -DFNT=${fnt}
+            -DPNG=${png}
+            -DNAME=${name}
+            "-DOPTIONS=${FONT_OPTIONS}"
+            -DOUT_DIR=${out_dir}
+            -P ${SMOOTH_FONT_GEN}
+        DEPENDS ${fnt} ${png} make_font ${SMOOTH_FONT_GEN}
+        COMMENT "Generating font ${name}"
+        VERBATIM)
+
+    set_source_files_properties(${out_dir}/${name}.h ${out_dir}/${name}.cpp
+        PROPERTIES GENERATED TRUE)
+
+    add_library(${name} STATIC ${out_dir}/${name}.cpp ${stamp})
+    target_include_directories(${name} PUBLIC ${out_dir} ${SMOOTH_FONT_INCLUDE})
+endfunction()
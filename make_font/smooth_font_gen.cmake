@@ -0,0 +1,45 @@
+# Run by add_smooth_font() (cmake -P) to generate one font.
+#
+# Inputs: TOOL, ROOT, FNT, PNG, NAME, OPTIONS, OUT_DIR
+
+file(MAKE_DIRECTORY ${OUT_DIR})
+
+set(hash_file ${OUT_DIR}/${NAME}.hash)
+set(h ${OUT_DIR}/${NAME}.h)
+set(cpp ${OUT_DIR}/${NAME}.cpp)
+
+file(SHA256 ${TOOL} tool_hash)
+file(SHA256 ${FNT} fnt_hash)
+file(SHA256 ${PNG} png_hash)
+string(SHA256 hash "${tool_hash};${fnt_hash};${png_hash};${NAME};${OPTIONS}")
+
+set(old_hash "")
+if(EXISTS ${hash_file})
+    file(READ ${hash_file} old_hash)
+endif()
+
+if(NOT hash STREQUAL old_hash OR NOT EXISTS ${h} OR NOT EXISTS ${cpp})
+    # generate in a scratch directory, then only replace what changed
+    set(tmp_dir ${OUT_DIR}/${NAME}.tmp)
+    file(REMOVE_RECURSE ${tmp_dir})
+    file(MAKE_DIRECTORY ${tmp_dir})
+
+    execute_process(
+        COMMAND ${TOOL} ${OPTIONS} -n ${NAME} -p ${PNG} ${ROOT}
+        WORKING_DIRECTORY ${tmp_dir}
+        RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        file(REMOVE ${hash_file})
+        message(FATAL_ERROR "make_font failed for ${NAME}: ${result}")
+    endif()
+
+    foreach(f ${NAME}.h ${NAME}.cpp)
+        execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different
+                        ${tmp_dir}/${f} ${OUT_DIR}/${f})
+    endforeach()
+    file(REMOVE_RECURSE ${tmp_dir})
+
+    file(WRITE ${hash_file} ${hash})
+endif()
+
+file(WRITE ${OUT_DIR}/${NAME}.stamp "${hash}\n")
@@ -0,0 +1,136 @@
+// Throughput of the blend kernels, for each pixel format and a range of
+// glyph widths.
+//
+// The font is made up here: every character is a glyph_width by 20 box
+// of gray levels (all 0..255), so each rendered row of a glyph is
+// glyph_width pixels through the kernel. Speeds are in million box pixels
+// per second, the best of several runs. With avx2 selected, rows narrower
+// than 16 pixels go through sse2 (see render.h), so avx2 and sse2 should
+// match there.
+//
+// Build with -DCMAKE_BUILD_TYPE=Release, or the numbers mean little.
+//
+// usage: render_bench [seconds per measurement (default 0.3)]
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "font.h"
+#include "render.h"
+
+
+static const struct {
+    const char *name;
+    RenderKernel kernel;
+} kernels[] = {
+    { "scalar", RenderKernel::scalar },
+    { "sse2", RenderKernel::sse2 },
+    { "avx2", RenderKernel::avx2 },
+};
+
+
+static const struct {
+    const char *name;
+    PixelFormat format;
+    int bytes;
+} formats[] = {
+    { "rgb565", PixelFormat::rgb565, 2 },
+    { "rgb565_ws24", PixelFormat::rgb565_ws24, 2 },
+    { "rgb888", PixelFormat::rgb888, 3 },
+};
+
+
+static const int glyph_widths[] = { 6, 10, 15, 16, 24, 32, 48 };
+
+static const int glyph_height = 20;
+
+static const char text[] = "The quick brown fox jumps over the lazy dog";
+
+// each measurement is the best of this many runs
+static const int runs = 10;
+
+
+// every printable character glyph_width by glyph_height, same gray data
+static void make_font(Font& font, std::vector<uint8_t>& data, int glyph_width)
+{
+    data.resize(glyph_width * glyph_height);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (i * 37) % 256;
+
+    memset(&font, 0, sizeof(font));
+    font.y_adv = glyph_height;
+    font.x_adv_max = glyph_width;
+    font.y_off_max = glyph_height;
+    font.x_off_max = glyph_width;
+    for (int c = 0; c < 128; c++)
+        font.info[c].off = -1;
+    for (int c = 32; c < 127; c++) {
+        font.info[c].off = 0;
+        font.info[c].w = glyph_width;
+        font.info[c].h = glyph_height;
+        font.info[c].x_adv = glyph_width;
+    }
+    font.data = data.data();
+}
+
+
+int main(int argc, char *argv[])
+{
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.3;
+
+    printf("%-12s %5s", "format", "width");
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+        printf(" %8s", kernels[k].name);
+    printf("   (Mpx/s)\n");
+
+    const int text_len = strlen(text);
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (size_t w = 0; w < sizeof(glyph_widths) / sizeof(glyph_widths[0]); w++) {
+            const int glyph_width = glyph_widths[w];
+
+            Font font;
+            std::vector<uint8_t> glyph_data;
+            make_font(font, glyph_data, glyph_width);
+
+            const int width = text_len * glyph_width;
+            std::vector<uint8_t> pix(glyph_height * width * formats[f].bytes);
+            Image img = { pix.data(), glyph_height, width,
+                          width * formats[f].bytes, formats[f].format };
+            const Rgb fg = { 250, 200, 40 };
+            const Rgb bg = { 20, 60, 160 };
+
+            printf("%-12s %5d", formats[f].name, glyph_width);
+            for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+                if (!render_kernel(kernels[k].kernel)) {
+                    printf(" %8s", "-");
+                    continue;
+                }
+
+                double best = 0;
+                for (int r = 0; r < runs; r++) {
+                    std::chrono::steady_clock::time_point start =
+                        std::chrono::steady_clock::now();
+                    double elapsed = 0;
+                    long pixels = 0;
+                    while (elapsed < seconds / runs) {
+                        for (int i = 0; i < 100; i++)
+                            render(img, font, 0, 0, fg, bg, text);
+                        pixels += 100L * glyph_height * width;
+                        elapsed = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start).count();
+                    }
+                    if (best < pixels / elapsed)
+                        best = pixels / elapsed;
+                }
+                printf(" %8.0f", best / 1e6);
+            }
+            printf("\n");
+        }
+    }
+
+    return 0;
+}
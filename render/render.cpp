@@ -0,0 +1,445 @@
+#include <stdint.h>
+#include <string.h>
+#include "font.h"
+#include "render.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RENDER_X86 1
+#include <immintrin.h>
+#else
+#define RENDER_X86 0
+#endif
+
+
+// Blend setup for one fg/bg pair, channel values in 16-bit lanes.
+//
+// Ws24::print() does
+//   r = bg_r + (fg_r - bg_r) * gray / 255
+// with C's truncating division. That is the same as adding or subtracting
+// |fg_r - bg_r| * gray / 255, which fits in 16 bits unsigned, and for
+// 0 <= t <= 65025, t / 255 == (t + 1 + (t >> 8)) >> 8. The SIMD kernels do
+// it that way; the scalar one just divides.
+struct Blend {
+    PixelFormat format;
+    uint16_t bg[3];     // r, g, b
+    uint16_t d[3];      // |fg - bg|
+    uint16_t neg[3];    // 0xffff if fg < bg, else 0
+    uint8_t bg_bytes[3]; // packed background, 2 or 3 bytes
+};
+
+
+static int bytes_per_pixel(PixelFormat format)
+{
+    return (format == PixelFormat::rgb888) ? 3 : 2;
+}
+
+
+static uint16_t pack_rgb565(int r, int g, int b)
+{
+    return ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+}
+
+
+static uint16_t swap16(uint16_t v)
+{
+    return (v << 8) | (v >> 8);
+}
+
+
+static void store_pixel(const Blend& bl, int r, int g, int b, uint8_t *out)
+{
+    if (bl.format == PixelFormat::rgb888) {
+        out[0] = r;
+        out[1] = g;
+        out[2] = b;
+    } else {
+        uint16_t v = pack_rgb565(r, g, b);
+        if (bl.format == PixelFormat::rgb565_ws24)
+            v = swap16(v);
+        memcpy(out, &v, sizeof(v));
+    }
+}
+
+
+static Blend blend_setup(PixelFormat format, Rgb fg, Rgb bg)
+{
+    // RGB565 formats blend between the colors as a Ws24 Pixel holds them
+    if (format != PixelFormat::rgb888) {
+        fg.r &= 0xf8; fg.g &= 0xfc; fg.b &= 0xf8;
+        bg.r &= 0xf8; bg.g &= 0xfc; bg.b &= 0xf8;
+    }
+
+    const int f[3] = { fg.r, fg.g, fg.b };
+    const int g[3] = { bg.r, bg.g, bg.b };
+
+    Blend bl;
+    bl.format = format;
+    for (int i = 0; i < 3; i++) {
+        bl.bg[i] = g[i];
+        bl.d[i] = (f[i] >= g[i]) ? (f[i] - g[i]) : (g[i] - f[i]);
+        bl.neg[i] = (f[i] >= g[i]) ? 0 : 0xffff;
+    }
+    store_pixel(bl, bg.r, bg.g, bg.b, bl.bg_bytes);
+
+    return bl;
+}
+
+
+static int blend_ch(const Blend& bl, int i, int gray)
+{
+    int q = bl.d[i] * gray / 255;
+    return bl.neg[i] ? (bl.bg[i] - q) : (bl.bg[i] + q);
+}
+
+
+// blend n gray values into n pixels
+static void blend_scalar(const Blend& bl, const uint8_t *gray, int n,
+                         uint8_t *out)
+{
+    const int bpp = bytes_per_pixel(bl.format);
+    for (int i = 0; i < n; i++) {
+        int r = blend_ch(bl, 0, gray[i]);
+        int g = blend_ch(bl, 1, gray[i]);
+        int b = blend_ch(bl, 2, gray[i]);
+        store_pixel(bl, r, g, b, out);
+        out += bpp;
+    }
+}
+
+
+#if RENDER_X86
+
+__attribute__((target("sse2")))
+static __m128i blend8_sse2(const Blend& bl, __m128i g16, __m128i ch[3])
+{
+    const __m128i one = _mm_set1_epi16(1);
+
+    for (int k = 0; k < 3; k++) {
+        __m128i d = _mm_set1_epi16(bl.d[k]);
+        __m128i neg = _mm_set1_epi16(bl.neg[k]);
+        __m128i t = _mm_mullo_epi16(g16, d);
+        __m128i q = _mm_srli_epi16(
+            _mm_add_epi16(_mm_add_epi16(t, one), _mm_srli_epi16(t, 8)), 8);
+        q = _mm_sub_epi16(_mm_xor_si128(q, neg), neg);
+        ch[k] = _mm_add_epi16(_mm_set1_epi16(bl.bg[k]), q);
+    }
+
+    // packed rgb565, or garbage if rgb888
+    __m128i v = _mm_or_si128(
+        _mm_or_si128(
+            _mm_slli_epi16(_mm_and_si128(ch[0], _mm_set1_epi16(0xf8)), 8),
+            _mm_slli_epi16(_mm_and_si128(ch[1], _mm_set1_epi16(0xfc)), 3)),
+        _mm_srli_epi16(ch[2], 3));
+    if (bl.format == PixelFormat::rgb565_ws24)
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    return v;
+}
+
+
+// Blend 8 gray values into 8 pixels; n < 8 means gray[] and out[] only
+// have n values, and go through a temporary block.
+__attribute__((target("sse2")))
+static void blend_block_sse2(const Blend& bl, const uint8_t *gray, int n,
+                             uint8_t *out)
+{
+    uint8_t gray_tmp[8];
+    if (n < 8) {
+        memset(gray_tmp, 0, sizeof(gray_tmp));
+        memcpy(gray_tmp, gray, n);
+        gray = gray_tmp;
+    }
+
+    __m128i ch[3];
+    __m128i v = blend8_sse2(bl, _mm_unpacklo_epi8(
+        _mm_loadl_epi64((const __m128i *)gray), _mm_setzero_si128()), ch);
+
+    if (bl.format == PixelFormat::rgb888) {
+        uint16_t rgb[3][8];
+        for (int k = 0; k < 3; k++)
+            _mm_storeu_si128((__m128i *)rgb[k], ch[k]);
+        for (int i = 0; i < n; i++) {
+            out[0] = rgb[0][i];
+            out[1] = rgb[1][i];
+            out[2] = rgb[2][i];
+            out += 3;
+        }
+    } else if (n == 8) {
+        _mm_storeu_si128((__m128i *)out, v);
+    } else {
+        uint16_t tmp[8];
+        _mm_storeu_si128((__m128i *)tmp, v);
+        memcpy(out, tmp, n * sizeof(uint16_t));
+    }
+}
+
+
+__attribute__((target("sse2")))
+static void blend_sse2(const Blend& bl, const uint8_t *gray, int n,
+                       uint8_t *out)
+{
+    const int bpp = bytes_per_pixel(bl.format);
+    for (int i = 0; i < n; i += 8) {
+        blend_block_sse2(bl, gray + i, (n - i < 8) ? (n - i) : 8, out);
+        out += 8 * bpp;
+    }
+}
+
+
+__attribute__((target("avx2")))
+static __m256i blend16_avx2(const Blend& bl, __m256i g16, __m256i ch[3])
+{
+    const __m256i one = _mm256_set1_epi16(1);
+
+    for (int k = 0; k < 3; k++) {
+        __m256i d = _mm256_set1_epi16(bl.d[k]);
+        __m256i neg = _mm256_set1_epi16(bl.neg[k]);
+        __m256i t = _mm256_mullo_epi16(g16, d);
+        __m256i q = _mm256_srli_epi16(
+            _mm256_add_epi16(_mm256_add_epi16(t, one),
+                             _mm256_srli_epi16(t, 8)), 8);
+        q = _mm256_sub_epi16(_mm256_xor_si256(q, neg), neg);
+        ch[k] = _mm256_add_epi16(_mm256_set1_epi16(bl.bg[k]), q);
+    }
+
+    __m256i v = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_slli_epi16(
+                _mm256_and_si256(ch[0], _mm256_set1_epi16(0xf8)), 8),
+            _mm256_slli_epi16(
+                _mm256_and_si256(ch[1], _mm256_set1_epi16(0xfc)), 3)),
+        _mm256_srli_epi16(ch[2], 3));
+    if (bl.format == PixelFormat::rgb565_ws24)
+        v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+    return v;
+}
+
+
+// same as blend_block_sse2(), 16 at a time
+__attribute__((target("avx2")))
+static void blend_block_avx2(const Blend& bl, const uint8_t *gray, int n,
+                             uint8_t *out)
+{
+    uint8_t gray_tmp[16];
+    if (n < 16) {
+        memset(gray_tmp, 0, sizeof(gray_tmp));
+        memcpy(gray_tmp, gray, n);
+        gray = gray_tmp;
+    }
+
+    __m256i ch[3];
+    __m256i v = blend16_avx2(bl, _mm256_cvtepu8_epi16(
+        _mm_loadu_si128((const __m128i *)gray)), ch);
+
+    if (bl.format == PixelFormat::rgb888) {
+        uint16_t rgb[3][16];
+        for (int k = 0; k < 3; k++)
+            _mm256_storeu_si256((__m256i *)rgb[k], ch[k]);
+        for (int i = 0; i < n; i++) {
+            out[0] = rgb[0][i];
+            out[1] = rgb[1][i];
+            out[2] = rgb[2][i];
+            out += 3;
+        }
+    } else if (n == 16) {
+        _mm256_storeu_si256((__m256i *)out, v);
+    } else {
+        uint16_t tmp[16];
+        _mm256_storeu_si256((__m256i *)tmp, v);
+        memcpy(out, tmp, n * sizeof(uint16_t));
+    }
+}
+
+
+__attribute__((target("avx2")))
+static void blend_avx2(const Blend& bl, const uint8_t *gray, int n,
+                       uint8_t *out)
+{
+    const int bpp = bytes_per_pixel(bl.format);
+    for (int i = 0; i < n; i += 16) {
+        blend_block_avx2(bl, gray + i, (n - i < 16) ? (n - i) : 16, out);
+        out += 16 * bpp;
+    }
+}
+
+#endif // RENDER_X86
+
+
+typedef void (*BlendFn)(const Blend& bl, const uint8_t *gray, int n,
+                        uint8_t *out);
+
+static RenderKernel best_kernel()
+{
+#if RENDER_X86
+    if (__builtin_cpu_supports("avx2"))
+        return RenderKernel::avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return RenderKernel::sse2;
+#endif
+    return RenderKernel::scalar;
+}
+
+static RenderKernel kernel = best_kernel();
+
+
+// Kernel for rows of n pixels. AVX2 works 16 pixels at a time, which for
+// narrower rows is all padding, so those go to SSE2 instead.
+static BlendFn blend_fn(int n)
+{
+#if RENDER_X86
+    if (kernel == RenderKernel::avx2)
+        return (n >= 16) ? blend_avx2 : blend_sse2;
+    if (kernel == RenderKernel::sse2)
+        return blend_sse2;
+#endif
+    return blend_scalar;
+}
+
+
+// select blend/pack kernel
+bool render_kernel(RenderKernel k)
+{
+    if (k != RenderKernel::scalar) {
+#if RENDER_X86
+        if (k == RenderKernel::avx2 && !__builtin_cpu_supports("avx2"))
+            return false;
+        if (k == RenderKernel::sse2 && !__builtin_cpu_supports("sse2"))
+            return false;
+#else
+        return false;
+#endif
+    }
+    kernel = k;
+    return true;
+}
+
+
+// kernel currently in use
+RenderKernel render_kernel()
+{
+    return kernel;
+}
+
+
+// fill rectangle with packed background from blend setup
+static void fill(const Image& img, int row, int col, int height, int width,
+                 const Blend& bl)
+{
+    // clip
+    if (row < 0) {
+        height += row;
+        row = 0;
+    }
+    if (col < 0) {
+        width += col;
+        col = 0;
+    }
+    if (row + height > img.height)
+        height = img.height - row;
+    if (col + width > img.width)
+        width = img.width - col;
+    if (height <= 0 || width <= 0)
+        return;
+
+    const int bpp = bytes_per_pixel(img.format);
+    uint8_t *first = img.data + row * img.stride + col * bpp;
+
+    // fill first row, then copy it to the rest
+    if (bpp == 2) {
+        // first may be odd-aligned (odd stride or col), so no uint16_t *
+        for (int c = 0; c < width; c++)
+            memcpy(first + c * 2, bl.bg_bytes, 2);
+    } else {
+        for (int c = 0; c < width; c++)
+            memcpy(first + c * 3, bl.bg_bytes, 3);
+    }
+
+    for (int r = 1; r < height; r++)
+        memcpy(first + r * img.stride, first, width * bpp);
+}
+
+
+// fill a rectangle with a solid color
+void render_fill(const Image& img, int row, int col, int height, int width,
+                 Rgb color)
+{
+    fill(img, row, col, height, width, blend_setup(img.format, color, color));
+}
+
+
+// render one character, clipping to image
+static void render_char(const Image& img, const Font& font, int row, int col,
+                        const Blend& bl, char c)
+{
+    const int height = font.y_adv;
+    const int x_adv = font.info[c].x_adv;
+    const int x_off = font.info[c].x_off;
+    const int y_off = font.info[c].y_off;
+    const int w = font.info[c].w;
+    const int h = font.info[c].h;
+
+    fill(img, row, col, height, x_adv, bl);
+
+    if (font.info[c].off < 0)
+        return;
+
+    const uint8_t *gs = font.data + font.info[c].off;
+    const int bpp = bytes_per_pixel(img.format);
+
+    // glyph columns that are inside both the character box and the image
+    int lo = 0;
+    if (lo < -x_off)
+        lo = -x_off;
+    if (lo < -x_off - col)
+        lo = -x_off - col;
+    int hi = w;
+    if (hi > x_adv - x_off)
+        hi = x_adv - x_off;
+    if (hi > img.width - col - x_off)
+        hi = img.width - col - x_off;
+    if (lo >= hi)
+        return;
+
+    const BlendFn blend = blend_fn(hi - lo);
+
+    for (int g_row = 0; g_row < h; g_row++) {
+        int p_row = g_row + y_off;
+        if (p_row < 0 || p_row >= height)
+            continue;
+        int r = row + p_row;
+        if (r < 0 || r >= img.height)
+            continue;
+        uint8_t *out = img.data + r * img.stride + (col + x_off + lo) * bpp;
+        blend(bl, gs + g_row * w + lo, hi - lo, out);
+    }
+}
+
+
+// render character
+int render(const Image& img, const Font& font, int row, int col,
+           Rgb fg, Rgb bg, char c)
+{
+    if (c < 0 || c > 127)
+        return col;
+
+    render_char(img, font, row, col, blend_setup(img.format, fg, bg), c);
+
+    return col + font.info[c].x_adv;
+}
+
+
+// render string
+int render(const Image& img, const Font& font, int row, int col,
+           Rgb fg, Rgb bg, const char *str)
+{
+    const Blend bl = blend_setup(img.format, fg, bg);
+
+    while (*str != '\0') {
+        char c = *str++;
+        if (c < 0 || c > 127)
+            continue;
+        render_char(img, font, row, col, bl, c);
+        col += font.info[c].x_adv;
+    }
+
+    return col;
+}
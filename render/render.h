@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+struct Font;
+
+
+// Host-side text rendering into caller-owned pixel buffers.
+//
+// Characters are drawn the same way Ws24::print() draws them on the
+// display: a y_adv by x_adv box of background, with the glyph blended into
+// it and cropped to the box. Anything outside the image is clipped.
+//
+// For the RGB565 formats, fg and bg are first reduced to what a Ws24 Pixel
+// can hold, and the blend is the same integer math as Ws24::print(), so
+// the pixels are exactly what would be sent to the display. RGB888 uses
+// the full 8-bit colors with the same blend.
+//
+// The blend and packing have SSE2 and AVX2 versions on x86, chosen at run
+// time. They give exactly the same results as the plain C++ version. With
+// AVX2 selected, glyph rows narrower than 16 pixels still use SSE2.
+//
+// Image data, stride, and columns need no particular alignment.
+
+
+enum class PixelFormat {
+    rgb565,         // uint16_t, red in the top bits, native byte order
+    rgb565_ws24,    // uint16_t, same as Ws24 Pixel::raw() (byte swapped)
+    rgb888,         // three bytes: r, g, b
+};
+
+
+// caller-owned image
+struct Image {
+    uint8_t *data;
+    int height;
+    int width;
+    int stride;     // bytes from one row to the next
+    PixelFormat format;
+};
+
+
+struct Rgb {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+
+enum class RenderKernel { scalar, sse2, avx2 };
+
+
+// Select blend/pack kernel. The best available is used by default.
+// Returns false (and changes nothing) if kernel is not supported here.
+bool render_kernel(RenderKernel kernel);
+
+// kernel currently in use
+RenderKernel render_kernel();
+
+// fill a rectangle with a solid color (clipped to image)
+void render_fill(const Image& img, int row, int col, int height, int width,
+                 Rgb color);
+
+// Render character with its box's top left at row, col.
+// Returns column of the next character.
+int render(const Image& img, const Font& font, int row, int col,
+           Rgb fg, Rgb bg, char c);
+
+// Render string starting at row, col.
+// Returns column after the last character.
+int render(const Image& img, const Font& font, int row, int col,
+           Rgb fg, Rgb bg, const char *str);
@@ -0,0 +1,388 @@
+// Host test of Ws24Bus scheduling.
+//
+// ws24_bus.cpp is compiled as it is, but the Ws24 methods it calls are
+// defined here, recording each call instead of sending anything. The
+// tests check the recorded calls: slicing, priority, taking turns, order
+// within a display, a full queue, and displays going away.
+//
+// usage: bus_test
+// Exit status is 0 if every check passes, 2 otherwise.
+
+#include <map>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "sprite.h"
+#include "ws24.h"
+#include "ws24_bus.h"
+
+
+// what the "displays" were asked to do, in order
+static std::vector<std::string> calls;
+
+// display names for the log
+static std::map<const Ws24 *, std::string> names;
+
+// sprite data is logged as an offset from here
+static const uint16_t *sprite_base;
+
+
+static void record(const Ws24 *panel, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void record(const Ws24 *panel, const char *fmt, ...)
+{
+    char buf[80];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    calls.push_back(names[panel] + " " + buf);
+}
+
+
+// Stub display: only the parts of Ws24 that Ws24Bus uses
+
+static SPIClass spi;
+static uint8_t work[64];
+
+Ws24::Ws24(SPIClass& spi, int, int, int, int, uint8_t *work, int work_bytes) :
+    _spi(spi),
+    _spi_settings(spi_clock, spi_bitorder, spi_mode),
+    _work(work),
+    _work_bytes(work_bytes),
+    _bus(nullptr)
+{
+}
+
+
+// same as the real one
+Ws24::~Ws24()
+{
+    if (_bus != nullptr)
+        _bus->remove(*this);
+}
+
+
+void Ws24::window(uint16_t row, uint16_t col, uint16_t height, uint16_t width)
+{
+    record(this, "window %d,%d %dx%d", row, col, height, width);
+}
+
+
+void Ws24::send_fill(uint8_t cmd, Pixel pixel, uint32_t count)
+{
+    record(this, "%02x fill %04x %u", cmd, pixel.raw(), (unsigned)count);
+}
+
+
+void Ws24::write(uint8_t cmd, const void *buf, int buf_len)
+{
+    record(this, "%02x data +%d %d", cmd,
+        int((const uint16_t *)buf - sprite_base), buf_len / 2);
+}
+
+
+void Ws24::write(uint16_t row, uint16_t col,
+                 uint16_t height, uint16_t width, Pixel pixel)
+{
+    record(this, "direct fill %d,%d %dx%d %04x", row, col, height, width,
+        pixel.raw());
+}
+
+
+void Ws24::write(uint16_t row, uint16_t col, const Sprite& sprite)
+{
+    record(this, "direct sprite %d,%d %dx%d", row, col, sprite.height,
+        sprite.width);
+}
+
+
+// a named display
+struct Panel {
+    Ws24 lcd;
+
+    Panel(const char *name) :
+        lcd(spi, 0, 0, 0, 0, work, sizeof(work))
+    {
+        names[&lcd] = name;
+    }
+};
+
+
+static int failed = 0;
+
+// compare the calls since the last check with expected, then forget them
+static void check(const char *test, const std::vector<std::string>& expected)
+{
+    if (calls != expected) {
+        fprintf(stderr, "%s: FAILED\n", test);
+        size_t n = (calls.size() > expected.size()) ? calls.size()
+                                                     : expected.size();
+        for (size_t i = 0; i < n; i++) {
+            const char *got = (i < calls.size()) ? calls[i].c_str() : "-";
+            const char *want = (i < expected.size()) ? expected[i].c_str() : "-";
+            fprintf(stderr, "  %c %-30s %s\n", (calls.size() > i &&
+                    expected.size() > i && calls[i] == expected[i]) ? ' ' : '*',
+                    got, want);
+        }
+        failed++;
+    } else {
+        printf("%s: ok\n", test);
+    }
+    calls.clear();
+}
+
+
+static void check_that(const char *test, bool ok)
+{
+    if (!ok) {
+        fprintf(stderr, "%s: FAILED\n", test);
+        failed++;
+    } else {
+        printf("%s: ok\n", test);
+    }
+}
+
+
+static const Pixel red(255, 0, 0); // raw 00f8
+static const Pixel blue(0, 0, 255); // raw 1f00
+
+
+// a fill is sent in slices, memory_write then memory_write_continue
+static void test_fill_slices()
+{
+    Panel a("A");
+    Ws24Bus bus(100);
+    bus.add(a.lcd);
+
+    bus.write(a.lcd, 10, 20, 10, 25, red);
+    check("fill queued", {});
+    check_that("fill busy", bus.busy(a.lcd));
+
+    bus.flush();
+    check("fill slices", {
+        "A window 10,20 10x25",
+        "A 2c fill 00f8 100",
+        "A 3c fill 00f8 100",
+        "A 3c fill 00f8 50",
+    });
+    check_that("fill done", !bus.busy());
+}
+
+
+// an uncompressed sprite is sent in slices from its own data
+static void test_sprite_slices()
+{
+    Panel a("A");
+    Ws24Bus bus(100);
+    bus.add(a.lcd);
+
+    static uint16_t data[250];
+    sprite_base = data;
+    const Sprite sprite = { 10, 25, false, 250, data };
+    bus.write(a.lcd, 5, 6, sprite);
+    bus.flush();
+    check("sprite slices", {
+        "A window 5,6 10x25",
+        "A 2c data +0 100",
+        "A 3c data +100 100",
+        "A 3c data +200 50",
+    });
+
+    // compressed sprites are drawn right away
+    const Sprite rle = { 10, 25, true, 4, data };
+    bus.write(a.lcd, 5, 6, rle);
+    check("sprite rle direct", {
+        "A direct sprite 5,6 10x25",
+    });
+    check_that("sprite rle not queued", !bus.busy());
+}
+
+
+// the highest priority display goes first, even if it queued later
+static void test_priority()
+{
+    Panel a("A");
+    Panel b("B");
+    Ws24Bus bus(100);
+    bus.add(a.lcd);
+    bus.add(b.lcd);
+
+    bus.write(a.lcd, 0, 0, 3, 100, red, 0);
+    bus.poll();
+    bus.write(b.lcd, 0, 0, 2, 100, blue, 1);
+    while (bus.poll())
+        ;
+    check("priority", {
+        "A window 0,0 3x100",
+        "A 2c fill 00f8 100",
+        "B window 0,0 2x100",
+        "B 2c fill 1f00 100",
+        "B 3c fill 1f00 100",
+        "A 3c fill 00f8 100",
+        "A 3c fill 00f8 100",
+    });
+}
+
+
+// displays with the same priority take turns, one slice each
+static void test_turns()
+{
+    Panel a("A");
+    Panel b("B");
+    Panel c("C");
+    Ws24Bus bus(100);
+    bus.add(a.lcd);
+    bus.add(b.lcd);
+    bus.add(c.lcd);
+
+    bus.write(a.lcd, 0, 0, 2, 100, red);
+    bus.write(b.lcd, 0, 0, 2, 100, red);
+    bus.write(c.lcd, 0, 0, 1, 100, red);
+    bus.flush();
+    check("turns", {
+        "A window 0,0 2x100",
+        "A 2c fill 00f8 100",
+        "B window 0,0 2x100",
+        "B 2c fill 00f8 100",
+        "C window 0,0 1x100",
+        "C 2c fill 00f8 100",
+        "A 3c fill 00f8 100",
+        "B 3c fill 00f8 100",
+    });
+}
+
+
+// one display's jobs are done in the order queued, whatever their priority
+static void test_order()
+{
+    Panel a("A");
+    Ws24Bus bus(100);
+    bus.add(a.lcd);
+
+    bus.write(a.lcd, 0, 0, 1, 150, red, 0);
+    bus.write(a.lcd, 1, 0, 1, 50, blue, 5);
+    bus.flush(a.lcd);
+    check("order", {
+        "A window 0,0 1x150",
+        "A 2c fill 00f8 100",
+        "A 3c fill 00f8 50",
+        "A window 1,0 1x50",
+        "A 2c fill 1f00 50",
+    });
+}
+
+
+// With the queue full, writing sends slices until a job finishes. A
+// display that was not added is drawn on directly.
+static void test_full()
+{
+    Panel a("A");
+    Panel b("B");
+    Ws24Bus bus(100);
+    bus.add(a.lcd);
+
+    for (int i = 0; i < 8; i++)
+        bus.write(a.lcd, i, 0, 1, 150, red);
+    check("full queued", {});
+
+    bus.write(a.lcd, 8, 0, 1, 150, red);
+    check("full makes room", {
+        "A window 0,0 1x150",
+        "A 2c fill 00f8 100",
+        "A 3c fill 00f8 50",
+    });
+
+    bus.flush();
+    int windows = 0;
+    for (size_t i = 0; i < calls.size(); i++)
+        if (calls[i].find("window") != std::string::npos)
+            windows++;
+    check_that("full all sent", windows == 8 && calls.back() == "A 3c fill 00f8 50" &&
+          calls[calls.size() - 3] == "A window 8,0 1x150");
+    calls.clear();
+
+    bus.write(b.lcd, 1, 2, 3, 4, blue);
+    check("not added", {
+        "B direct fill 1,2 3x4 1f00",
+    });
+}
+
+
+// empty fills and sprites are dropped
+static void test_empty()
+{
+    Panel a("A");
+    Ws24Bus bus(100);
+    bus.add(a.lcd);
+
+    bus.write(a.lcd, 0, 0, 0, 10, red);
+    bus.write(a.lcd, 0, 0, 10, 0, red);
+    const Sprite sprite = { 0, 0, false, 0, nullptr };
+    bus.write(a.lcd, 0, 0, sprite);
+    check_that("empty busy", !bus.busy());
+    bus.flush();
+    check("empty", {});
+}
+
+
+// a display destroyed while added finishes its jobs and leaves the bus
+static void test_remove()
+{
+    Panel b("B");
+    Panel c("C");
+    Ws24Bus bus(100);
+    Panel *a = new Panel("A");
+    bus.add(a->lcd);
+    bus.add(b.lcd);
+    bus.add(c.lcd);
+
+    bus.write(a->lcd, 0, 0, 2, 100, red);
+    bus.write(b.lcd, 0, 0, 2, 100, red);
+    bus.write(c.lcd, 0, 0, 2, 100, red);
+    bus.poll();
+    bus.poll();
+    check("remove before", {
+        "A window 0,0 2x100",
+        "A 2c fill 00f8 100",
+        "B window 0,0 2x100",
+        "B 2c fill 00f8 100",
+    });
+
+    delete a;
+    check("remove flushes", {
+        "A 3c fill 00f8 100",
+    });
+
+    // C was next before A went away, and still is
+    bus.flush();
+    check("remove turns", {
+        "C window 0,0 2x100",
+        "C 2c fill 00f8 100",
+        "B 3c fill 00f8 100",
+        "C 3c fill 00f8 100",
+    });
+
+    // and there is room for another display
+    Panel d("D");
+    Panel e("E");
+    check_that("remove add", bus.add(d.lcd) && bus.add(e.lcd));
+}
+
+
+int main()
+{
+    test_fill_slices();
+    test_sprite_slices();
+    test_priority();
+    test_turns();
+    test_order();
+    test_full();
+    test_empty();
+    test_remove();
+
+    return (failed > 0) ? 2 : 0;
+}
@@ -0,0 +1,276 @@
+// Golden-image test for generated fonts.
+//
+// The fonts linked in here were generated by make_font at build time
+// (add_smooth_font()), so this checks the generated .cpp as compiled, not
+// make_font's own idea of the glyphs. Each font is drawn with the host
+// renderer, once per blend kernel available, and compared with a checked
+// in png.
+//
+// usage: golden [-u] [-t tolerance] <golden_dir> <font>...
+//   -u  write the golden pngs instead of comparing (review them first!)
+//   -t  per-channel difference allowed (default 0)
+// Exit status is 0 if everything matches, 1 on error, 2 on mismatch.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <png.h>
+
+#include "font.h"
+#include "render.h"
+#include "mono_24.h"
+#include "prop_20.h"
+#include "prop_20_bin.h"
+#include "prop_20_xml.h"
+
+
+// The prop_20 variants are the same font as .fnt in other formats, so they
+// share its golden png.
+static const struct {
+    const char *name;
+    const char *golden;
+    const Font& font;
+} fonts[] = {
+    { "mono_24", "mono_24", mono_24 },
+    { "prop_20", "prop_20", prop_20 },
+    { "prop_20_bin", "prop_20", prop_20_bin },
+    { "prop_20_xml", "prop_20", prop_20_xml },
+};
+
+
+static const struct {
+    const char *name;
+    RenderKernel kernel;
+} kernels[] = {
+    { "scalar", RenderKernel::scalar },
+    { "sse2", RenderKernel::sse2 },
+    { "avx2", RenderKernel::avx2 },
+};
+
+
+// milliseconds since the last call
+static double lap_ms()
+{
+    static std::chrono::steady_clock::time_point last;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - last).count();
+    last = now;
+    return ms;
+}
+
+
+// Draw the font the way the display would show it: every character in a
+// 16 by 8 grid of x_adv_max by y_adv cells, black on white and again in
+// colors where fg < bg in some channels, then a line of text. Rendered as
+// RGB565 (what is sent to the display) and expanded to rgb for the png.
+static std::vector<uint8_t> specimen(const Font& font, int *height, int *width)
+{
+    const int cell_h = font.y_adv;
+    const int cell_w = font.x_adv_max;
+    *height = 17 * cell_h;
+    *width = 16 * cell_w;
+
+    std::vector<uint8_t> pix(*height * *width * 2);
+    Image img = { pix.data(), *height, *width, *width * 2, PixelFormat::rgb565 };
+
+    const Rgb white = { 255, 255, 255 };
+    const Rgb black = { 0, 0, 0 };
+    const Rgb fg = { 250, 200, 40 };
+    const Rgb bg = { 20, 60, 160 };
+
+    render_fill(img, 0, 0, *height, *width, white);
+    for (int c = 1; c < 128; c++) {
+        int row = (c / 16) * cell_h;
+        int col = (c % 16) * cell_w;
+        render(img, font, row, col, black, white, (char)c);
+        render(img, font, row + 8 * cell_h, col, fg, bg, (char)c);
+    }
+    render(img, font, 16 * cell_h, 0, black, white,
+           "The quick brown fox jumps over the lazy dog.");
+
+    std::vector<uint8_t> rgb(*height * *width * 3);
+    for (int i = 0; i < *height * *width; i++) {
+        uint16_t v;
+        memcpy(&v, &pix[i * 2], sizeof(v));
+        rgb[i * 3 + 0] = (v >> 8) & 0xf8;
+        rgb[i * 3 + 1] = (v >> 3) & 0xfc;
+        rgb[i * 3 + 2] = (v << 3) & 0xf8;
+    }
+    return rgb;
+}
+
+
+static bool write_png(const std::string& fn, const std::vector<uint8_t>& rgb,
+                      int height, int width)
+{
+    FILE *fp = fopen(fn.c_str(), "wb");
+    if (fp == NULL) {
+        perror(fn.c_str());
+        return false;
+    }
+
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+                                                  NULL, NULL, NULL);
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        fclose(fp);
+        return false;
+    }
+    png_init_io(png_ptr, fp);
+    png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png_ptr, info_ptr);
+    for (int r = 0; r < height; r++)
+        png_write_row(png_ptr, (png_const_bytep)&rgb[r * width * 3]);
+    png_write_end(png_ptr, info_ptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+    return fclose(fp) == 0;
+}
+
+
+static bool read_png(const std::string& fn, std::vector<uint8_t>& rgb,
+                     int *height, int *width)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&image, fn.c_str())) {
+        fprintf(stderr, "%s: %s\n", fn.c_str(), image.message);
+        return false;
+    }
+    image.format = PNG_FORMAT_RGB;
+    rgb.resize(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, NULL, rgb.data(), 0, NULL)) {
+        fprintf(stderr, "%s: %s\n", fn.c_str(), image.message);
+        return false;
+    }
+    *height = image.height;
+    *width = image.width;
+    return true;
+}
+
+
+// number of pixels differing by more than tolerance in some channel
+static int compare(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b,
+                   int width, int tolerance, const char *what)
+{
+    int bad = 0;
+    for (size_t i = 0; i < a.size(); i += 3) {
+        int diff = 0;
+        for (int k = 0; k < 3; k++) {
+            int d = abs((int)a[i + k] - (int)b[i + k]);
+            if (diff < d)
+                diff = d;
+        }
+        if (diff > tolerance) {
+            if (bad < 10) {
+                int p = i / 3;
+                fprintf(stderr, "%s: row %d col %d differs by %d\n",
+                        what, p / width, p % width, diff);
+            }
+            bad++;
+        }
+    }
+    return bad;
+}
+
+
+int main(int argc, char *argv[])
+{
+    bool update = false;
+    int tolerance = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "ut:")) != -1) {
+        switch (opt) {
+        case 'u':
+            update = true;
+            break;
+        case 't':
+            tolerance = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-u] [-t tolerance] <golden_dir> <font>...\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (optind > argc - 2) {
+        fprintf(stderr, "usage: %s [-u] [-t tolerance] <golden_dir> <font>...\n",
+                argv[0]);
+        return 1;
+    }
+    const std::string dir = argv[optind];
+
+    int status = 0;
+    for (int a = optind + 1; a < argc; a++) {
+        const Font *font = NULL;
+        const char *golden_name = NULL;
+        for (size_t f = 0; f < sizeof(fonts) / sizeof(fonts[0]); f++) {
+            if (strcmp(argv[a], fonts[f].name) == 0) {
+                font = &fonts[f].font;
+                golden_name = fonts[f].golden;
+            }
+        }
+        if (font == NULL) {
+            fprintf(stderr, "%s: not linked in\n", argv[a]);
+            return 1;
+        }
+        const std::string fn = dir + "/" + golden_name + ".png";
+
+        if (update) {
+            render_kernel(RenderKernel::scalar);
+            int height, width;
+            std::vector<uint8_t> rgb = specimen(*font, &height, &width);
+            if (!write_png(fn, rgb, height, width))
+                return 1;
+            printf("%s: wrote %s\n", argv[a], fn.c_str());
+            continue;
+        }
+
+        lap_ms();
+        std::vector<uint8_t> golden;
+        int g_height, g_width;
+        if (!read_png(fn, golden, &g_height, &g_width))
+            return 1;
+        printf("%s: read golden %.3f ms\n", argv[a], lap_ms());
+
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            if (!render_kernel(kernels[k].kernel)) {
+                printf("%s: %s not available here\n", argv[a], kernels[k].name);
+                continue;
+            }
+
+            lap_ms();
+            int height, width;
+            std::vector<uint8_t> rgb = specimen(*font, &height, &width);
+            double render_ms = lap_ms();
+
+            if (height != g_height || width != g_width) {
+                fprintf(stderr, "%s: %dx%d, golden is %dx%d\n", argv[a],
+                        width, height, g_width, g_height);
+                status = 2;
+                continue;
+            }
+
+            std::string what = std::string(argv[a]) + " " + kernels[k].name;
+            int bad = compare(rgb, golden, width, tolerance, what.c_str());
+            double compare_ms = lap_ms();
+
+            printf("%s: render %.3f ms, compare %.3f ms, %d pixels differ "
+                   "by more than %d\n", what.c_str(), render_ms, compare_ms,
+                   bad, tolerance);
+            if (bad > 0)
+                status = 2;
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,174 @@
+// Host test of the text layout helpers (arduino/libraries/fonts/layout.h).
+//
+// They only look at glyph widths, so the font here has no glyph data:
+// every printable character is 10 pixels wide, except space, which is 5.
+//
+// usage: layout_test
+// Exit status is 0 if every check passes, 2 otherwise.
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "font.h"
+#include "layout.h"
+
+
+static Font font;
+
+static void make_font()
+{
+    memset(&font, 0, sizeof(font));
+    font.y_adv = 12;
+    font.x_adv_max = 10;
+    for (int c = 33; c < 127; c++)
+        font.info[c].x_adv = 10;
+    font.info[' '].x_adv = 5;
+}
+
+
+static int failed = 0;
+
+static void check(const char *test, bool ok)
+{
+    if (!ok) {
+        fprintf(stderr, "%s: FAILED\n", test);
+        failed++;
+    } else {
+        printf("%s: ok\n", test);
+    }
+}
+
+
+static void check(const char *test, int got, int expected)
+{
+    if (got != expected) {
+        fprintf(stderr, "%s: FAILED, got %d, expected %d\n",
+                test, got, expected);
+        failed++;
+    } else {
+        printf("%s: ok\n", test);
+    }
+}
+
+
+// Wrap str in width pixels, giving each line as "text/width", with the
+// line's text as text_wrap() measured it.
+static std::vector<std::string> wrap(const char *str, int width)
+{
+    std::vector<std::string> lines;
+    while (*str != '\0') {
+        int len, line_width;
+        const char *next = text_wrap(font, str, width, &len, &line_width);
+        lines.push_back(std::string(str, len) + "/" +
+                        std::to_string(line_width));
+        if (next == str) {
+            lines.push_back("(no progress)");
+            break;
+        }
+        str = next;
+    }
+    return lines;
+}
+
+
+static void check(const char *test, const char *str, int width,
+                  const std::vector<std::string>& expected)
+{
+    std::vector<std::string> got = wrap(str, width);
+    if (got != expected) {
+        fprintf(stderr, "%s: FAILED\n", test);
+        for (size_t i = 0; i < got.size(); i++)
+            fprintf(stderr, "  got \"%s\"\n", got[i].c_str());
+        for (size_t i = 0; i < expected.size(); i++)
+            fprintf(stderr, "  expected \"%s\"\n", expected[i].c_str());
+        failed++;
+    } else {
+        printf("%s: ok\n", test);
+    }
+    check((std::string(test) + " lines").c_str(),
+          text_lines(font, str, width), expected.size());
+}
+
+
+static void test_width()
+{
+    check("width", text_width(font, "abc"), 30);
+    check("width space", text_width(font, "a b"), 25);
+    check("width len", text_width(font, "abc", 2), 20);
+    check("width len 0", text_width(font, "abc", 0), 0);
+    check("width len past end", text_width(font, "abc", 10), 30);
+    check("width empty", text_width(font, ""), 0);
+    check("width not in font", text_width(font, "a\x01\xe9"), 10);
+}
+
+
+static void test_wrap()
+{
+    check("wrap fits", "abc", 30, { "abc/30" });
+    check("wrap at space", "hello world", 60, { "hello/50", "world/50" });
+    check("wrap two spaces", "ab  cd ef", 60, { "ab  cd/50", "ef/20" });
+
+    // spaces at a soft break are skipped, however many
+    check("wrap space run", "ab     cd", 40, { "ab/20", "cd/20" });
+
+    // trailing spaces are not part of the line
+    check("wrap trailing", "ab   ", 100, { "ab/20" });
+    check("wrap only spaces", "   ", 100, { "/0" });
+
+    // leading spaces are kept
+    check("wrap leading", "  ab", 100, { "  ab/30" });
+
+    // a word wider than the box is broken where it stops fitting
+    check("wrap long word", "abcdefgh", 35, { "abc/30", "def/30", "gh/20" });
+    check("wrap long word after", "ab abcdefgh", 35,
+          { "ab/20", "abc/30", "def/30", "gh/20" });
+
+    // narrower than one glyph: one character per line
+    check("wrap narrow", "abc", 5, { "a/10", "b/10", "c/10" });
+    check("wrap zero width", "ab", 0, { "a/10", "b/10" });
+    check("wrap narrow space", " a", 3, { "/0", "a/10" });
+
+    // '\n' always ends a line
+    check("wrap newline", "ab\ncd", 100, { "ab/20", "cd/20" });
+    check("wrap newline trailing", "ab  \ncd", 100, { "ab/20", "cd/20" });
+    check("wrap newline last", "ab\n", 100, { "ab/20" });
+    check("wrap blank lines", "\n\nab", 100, { "/0", "/0", "ab/20" });
+
+    check("wrap empty", "", 100, {});
+
+    int len = -1, line_width = -1;
+    const char *str = "";
+    check("wrap empty end", text_wrap(font, str, 100, &len, &line_width) == str
+          && len == 0 && line_width == 0);
+}
+
+
+static void test_align()
+{
+    check("align left", text_align(10, 32, 17, Align::left), 10);
+    check("align right", text_align(10, 32, 17, Align::right), 25);
+    check("align center", text_align(10, 32, 16, Align::center), 18);
+
+    // odd sizes round each half toward zero
+    check("align center odd line", text_align(0, 32, 17, Align::center), 8);
+    check("align center odd span", text_align(0, 33, 16, Align::center), 8);
+    check("align center both odd", text_align(0, 33, 17, Align::center), 8);
+
+    // too wide hangs out
+    check("align center wide", text_align(0, 10, 15, Align::center), -2);
+    check("align right wide", text_align(0, 10, 15, Align::right), -5);
+}
+
+
+int main()
+{
+    make_font();
+
+    test_width();
+    test_wrap();
+    test_align();
+
+    return (failed > 0) ? 2 : 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Just enough of the Arduino core for host tests of code that takes a
+// display (Ws24), where the test supplies the display's methods.
+
+#include <stdint.h>
+#include <string.h>
@@ -0,0 +1,18 @@
+#pragma once
+
+// Just enough of the Arduino SPI library for ws24.h to compile on the
+// host; nothing here is ever sent.
+
+#include <stdint.h>
+
+enum BitOrder { LSBFIRST, MSBFIRST };
+
+enum SPIMode { SPI_MODE0, SPI_MODE1, SPI_MODE2, SPI_MODE3 };
+
+class SPISettings {
+    public:
+        SPISettings(uint32_t, BitOrder, SPIMode) {}
+};
+
+class SPIClass {
+};